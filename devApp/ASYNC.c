@@ -0,0 +1,38 @@
+/*
+ * Asynchronous launch with transfers into the running DPU
+ * Tasklets sum their slice of MRAM, then the DPU keeps running until the host
+ * posts a bias with DPU_XFER_PARALLEL. Tasklet 0 raises `summed` once every
+ * tasklet is done so the host, polling it the same way, knows when to post.
+ */
+#include "moredefs.h"
+#include <mram.h>
+#include <stdint.h>
+
+#define BLOCK_WORDS 64
+__host uint32_t nrWords; // Per DPU, a multiple of NR_TASKLETS * BLOCK_WORDS
+__host volatile uint32_t summed;
+__host volatile uint32_t bias;
+__host uint32_t sums[NR_TASKLETS];
+ALL_THREADS_BARRIER_INIT();
+
+int main() {
+  uint32_t tasklet_id = me();
+  uint32_t tlWords = nrWords / NR_TASKLETS, sum = 0;
+  __mram_ptr uint32_t *in =
+      (__mram_ptr uint32_t *)DPU_MRAM_HEAP_POINTER + tasklet_id * tlWords;
+  uint64_t buf_[BLOCK_WORDS / 2]; // 8B aligned for the DMA
+  uint32_t *buf = (uint32_t *)buf_;
+  for (uint32_t i = 0; i < tlWords; i += BLOCK_WORDS) {
+    mram_read(in + i, buf, sizeof(buf_));
+    for (uint32_t j = 0; j < BLOCK_WORDS; ++j)
+      sum += buf[j];
+  }
+
+  all_threads_barrier_wait();
+  if (tasklet_id == 0)
+    summed = 1;
+  while (bias == 0)
+    ;
+  sums[tasklet_id] = sum + bias;
+  return 0;
+}
@@ -0,0 +1,23 @@
+/*
+ * Tasklets that trap
+ * Odd tasklets abort() halfway through their loop, which stops only them on
+ * the functional-only engines. Even tasklets keep running and store their sum.
+ */
+#include "moredefs.h"
+#include <alloc.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+__host uint32_t nrIter;
+__host uint32_t sums[NR_TASKLETS];
+
+int main() {
+  uint32_t tasklet_id = me(), sum = tasklet_id;
+  for (uint32_t i = 0; i < nrIter; ++i) {
+    if ((tasklet_id & 1) && i == nrIter / 2)
+      abort();
+    sum += i ^ tasklet_id;
+  }
+  sums[tasklet_id] = sum;
+  return 0;
+}
@@ -35,11 +35,19 @@ struct DmmDpuRecord {
 extern struct DmmDpuRecord DmmDpuRecords[2048];
 #ifdef __cplusplus
 extern std::atomic<size_t> NrDmmDpuRecord, DmmTotExecUsec, DmmTotXferUsec;
+extern std::atomic<size_t> DmmTotParallelXferUsec;
 extern thread_local size_t DmmLastRecordIdx;
 #else
 extern atomic_size_t NrDmmDpuRecord, DmmTotExecUsec, DmmTotXferUsec;
+// DPU_XFER_PARALLEL transfers, which overlap execution; not in DmmDpuRecords
+extern atomic_size_t DmmTotParallelXferUsec;
 extern _Thread_local size_t DmmLastRecordIdx;
 #endif
+// Host wall-clock each simulation thread spent running DPUs, and spent with
+// nothing to take while queued jobs remained
+enum { DmmMaxNrSimThrd = 512 };
+extern size_t DmmSimThrdBusyUsec[DmmMaxNrSimThrd];
+extern size_t DmmSimThrdIdleUsec[DmmMaxNrSimThrd];
 
 #ifndef __DMM_NOXFER
 // Estimates the overhead of a given transfer.
@@ -53,12 +61,46 @@ uint64_t DmmXferOverhead(size_t nrDpu, void *xferAddrs[], uint64_t xferSz,
 typedef void* DmmMap;
 DmmMap DmmMapInit(size_t initCap);
 void DmmMapAssign(DmmMap map, const void *str, size_t sz, uint_fast32_t val);
+// Like DmmMapAssign, but the map keeps its own copy of str until cleared
+void DmmMapAssignCopy(DmmMap map, const void *str, size_t sz,
+                      uint_fast32_t val);
 uint_fast32_t DmmMapFetch(DmmMap map, const void* str, size_t sz);
+// Next entry from *at, which starts at 0; false past the last one
+bool DmmMapIter(DmmMap map, size_t *at, const void **str, size_t *sz,
+                uint_fast32_t *val);
 void DmmMapFini(DmmMap map);
 void DmmMapClear(DmmMap map);
 enum { MapNoInt = 0x44f8a1ef, noAddr = 0x44f8a1ef };
 typedef size_t DmmSymAddr;
 
+// Zeroed WMAram images of nrByte bytes on numaNode (any node if negative),
+// from a per-process pool: freed images are reused instead of unmapped, and
+// only the pages written since are zeroed again
+uint8_t *DmmWmaAlloc(size_t nrByte, int numaNode);
+void DmmWmaFree(uint8_t *wma, size_t nrByte);
+// A loaded program's image in a memfd, which images from DmmWmaAlloc map
+// copy-on-write over its pages [From, To) instead of copying them. Only built
+// for DmmWmaCowMinNrPage initialized pages or more; smaller ones are copied.
+typedef struct {
+  int Fd;
+  size_t From, To;
+} DmmWmaCow;
+enum { DmmWmaCowMinNrPage = 64 };
+bool DmmWmaCowInit(DmmWmaCow *c, const uint8_t *wma, size_t nrByte,
+                   const bool *paged);
+void DmmWmaCowMap(const DmmWmaCow *c, uint8_t *wma, size_t nrByte);
+void DmmWmaCowFini(DmmWmaCow *c);
+// Back images allocated from now on by a sparse, unlinked file in dir rather
+// than anonymous memory, so that simulations may exceed RAM. Past rssCapMb
+// resident (0 for no cap), DmmWmaTouch pages out the images least recently
+// touched. Returns false, leaving images anonymous, if no file can be made.
+bool DmmWmaSpillInit(const char *dir, size_t rssCapMb);
+void DmmWmaTouch(uint8_t *wma, size_t nrByte);
+// Bytes of [from, to) of an image up to and including the highest page ever
+// touched since it was allocated; spilled ones round up to page cache folios
+size_t DmmWmaHighWater(const uint8_t *wma, size_t nrByte,
+                       size_t from, size_t to);
+
 // --- Common Constants (ISA-agnostic) ---
 enum {
   MaxNumTasklets = 24,
@@ -77,12 +119,16 @@ enum {
 typedef struct {
   long address;
   long thrd_id;
+  long nr; // Identical commands in a run, queues only
 } _memcmd;
+enum { _memcmdNrRowHash = 64 };
 typedef struct {
-  _memcmd* data;
-  size_t capacity;
+  _memcmd* data;  // Ring of runs
+  size_t capacity; // Power of two, grows only when full
   size_t size;
-  size_t offset;  // For efficient front removal
+  size_t head;
+  // Runs per hashed row, so most row misses need no scan
+  uint32_t nrRunOfRow[_memcmdNrRowHash];
 } _memcmdSlice;
 
 typedef struct MramTiming {
@@ -102,6 +148,9 @@ typedef struct MramTiming {
   long NrWait;
   long AckLeft[MaxNumTasklets];
   long ReadyId;
+#ifdef __DMM_EVENT_DRIVEN
+  long NrIdle; // upcoming cycles known to move no command, reset by pushes
+#endif
 
   long StatMemoryCycle;
   long StatNrFr;
@@ -113,6 +162,21 @@ void DmmMramTimingInit(DmmMramTiming* mt);
 void DmmMramTimingFini(DmmMramTiming* mt);
 void DmmMramTimingPush(DmmMramTiming* mt, long begin_addr, long size, long thrd_id);
 void DmmMramTimingCycle(DmmMramTiming* mt);
+// Memory cycles stepped by the logic cycle that starts at totNrCycle
+static inline long DmmMramCyclesAt(double freqRatio, long totNrCycle) {
+  return (long)(freqRatio * (double)totNrCycle -
+                freqRatio * (double)(totNrCycle - 1));
+}
+#ifdef __DMM_EVENT_DRIVEN
+// Same as nrCycle calls to DmmMramTimingCycle, but jumps over the cycles in
+// which no command moves and over streams of row hits
+void DmmMramTimingRun(DmmMramTiming* mt, long nrCycle);
+// Step the model logic cycle by logic cycle from totNrCycle on, through the
+// end of the first logic cycle that acks a tasklet. Returns how many logic
+// cycles that took.
+long DmmMramTimingRunToAck(DmmMramTiming* mt, double freqRatio,
+                           long totNrCycle);
+#endif
 static inline bool DmmMramTimingCanPop(DmmMramTiming* mt) {
   return mt->ReadyId >= 0;
 }
@@ -122,6 +186,113 @@ static inline long DmmMramTimingPop(DmmMramTiming* mt) {
   return val;
 }
 
+// --- Tasklet issue masks ---
+// Rotate the low n bits of mask right by k, so bit k becomes bit 0
+static inline uint32_t DmmRotMask(uint32_t mask, unsigned k, unsigned n) {
+  uint64_t m = mask;
+  return (uint32_t)((m >> k | m << (n - k)) & ((1ull << n) - 1));
+}
+
+// Bit i of Mask is set while lastRunAt[i] + NrRevolveCycle > TotNrCycle.
+// SetAt[c % 16] holds the bits set at cycle c, one at most per cycle, so
+// each cycle retires one slot as long as NrRevolveCycle <= 16.
+typedef struct {
+  uint32_t Mask;
+  uint32_t SetAt[16];
+} DmmRevolver;
+
+// Timing starts at cycle 0 with every lastRunAt at 0
+static inline void DmmRevolverInit(DmmRevolver* r) {
+  memset(r, 0, sizeof(DmmRevolver));
+  r->Mask = r->SetAt[0] = (1u << MaxNumTasklets) - 1;
+}
+// Bits of the slot set NrRevolveCycle cycles before now that expire now.
+// The rest were set again since and sit in a later slot.
+static inline uint32_t DmmRevolverExpiring(const DmmRevolver* r,
+                                           const long* lastRunAt, long now) {
+  uint32_t ret = 0;
+  for (uint32_t b = r->SetAt[(now - NrRevolveCycle) & 15]; b; b &= b - 1)
+    if (lastRunAt[__builtin_ctz(b)] + NrRevolveCycle <= now)
+      ret |= b & -b;
+  return ret;
+}
+// Call once per cycle, right after the cycle count moves to now
+static inline void DmmRevolverTick(DmmRevolver* r, const long* lastRunAt,
+                                   long now) {
+  r->Mask &= ~DmmRevolverExpiring(r, lastRunAt, now);
+  r->SetAt[(now - NrRevolveCycle) & 15] = 0;
+}
+// Catch up after the cycle count jumped to now without ticks
+static inline void DmmRevolverSkip(DmmRevolver* r, const long* lastRunAt,
+                                   long now) {
+  for (int i = 0; i < 16; i++)
+    for (uint32_t b = r->SetAt[i]; b; b &= b - 1)
+      if (lastRunAt[__builtin_ctz(b)] + NrRevolveCycle <= now) {
+        r->Mask &= ~(b & -b);
+        r->SetAt[i] &= ~(b & -b);
+      }
+}
+static inline void DmmRevolverSet(DmmRevolver* r, long id, long now) {
+  r->Mask |= 1u << id;
+  r->SetAt[now & 15] |= 1u << id;
+}
+
+// --- Host transfers into running DPUs (DPU_XFER_PARALLEL) ---
+// The host posts one WRAM transfer into a DPU's mailbox. A running DPU
+// applies it at its first logic cycle at or past a multiple of
+// DmmPollNrCycle (executed instruction when functional only, checked once a
+// round of tasklets by threaded code); a DPU not running is written by the
+// host itself.
+enum {
+  DmmPollNrCycle = 1024,
+  DmmMailboxFree = 0, DmmMailboxDpu = 1, DmmMailboxHost = 2,
+};
+typedef struct {
+  uint8_t *Host;
+  size_t WAddr, Length;
+  bool ToDpu;
+  bool Done;
+} DmmPost;
+typedef struct {
+  DmmPost *Post;  // Pending transfer, taken by whoever applies it
+  uint32_t Owner; // Who may touch WMAram: DmmMailboxFree, Dpu or Host
+  long PollAt;    // Cycle of the next poll by the running DPU
+} DmmMailbox;
+
+static inline void DmmMailboxApply(DmmMailbox* mb, uint8_t* wma) {
+  DmmPost* p = __atomic_exchange_n(&mb->Post, NULL, __ATOMIC_ACQ_REL);
+  if (p == NULL)
+    return;
+  if (p->ToDpu)
+    memcpy(wma + p->WAddr, p->Host, p->Length);
+  else
+    memcpy(p->Host, wma + p->WAddr, p->Length);
+  __atomic_store_n(&p->Done, true, __ATOMIC_RELEASE);
+}
+// Try to take the mailbox for whom; spins if the host is mid transfer
+static inline bool DmmMailboxTake(DmmMailbox* mb, uint32_t whom) {
+  uint32_t idle = DmmMailboxFree;
+  return __atomic_compare_exchange_n(&mb->Owner, &idle, whom, false,
+                                     __ATOMIC_ACQUIRE, __ATOMIC_RELAXED);
+}
+// A DPU run starts at cycle now
+static inline void DmmMailboxOpen(DmmMailbox* mb, uint8_t* wma, long now) {
+  while (!DmmMailboxTake(mb, DmmMailboxDpu))
+    ;
+  mb->PollAt = (now / DmmPollNrCycle + 1) * DmmPollNrCycle;
+  DmmMailboxApply(mb, wma);
+}
+static inline void DmmMailboxPoll(DmmMailbox* mb, uint8_t* wma, long now) {
+  if (now < mb->PollAt)
+    return;
+  mb->PollAt = (now / DmmPollNrCycle + 1) * DmmPollNrCycle;
+  DmmMailboxApply(mb, wma);
+}
+static inline void DmmMailboxClose(DmmMailbox* mb, uint8_t* wma) {
+  DmmMailboxApply(mb, wma);
+  __atomic_store_n(&mb->Owner, DmmMailboxFree, __ATOMIC_RELEASE);
+}
+
 #ifdef __cplusplus
 } /* extern "C" */
 #endif
@@ -11,13 +11,30 @@ enum DmmDpuIs {
   RV_DPUIS = 2,
 };
 
+// What the DPUs loaded together share, see ummHostApi.c
+struct DmmSharedPrg;
+
 // Unified DPU structure that can handle both ISAs
 struct DmmDpu {
   enum DmmDpuIs Is;
+  float RunUsec; // Host wall-clock of its last run, sizes the next launch
+  uint32_t MramHighKb; // Most MRAM any program loaded on it touched so far,
+                       // updated on dpu_load, dpu_free and TSC dumps
+  struct DmmSharedPrg *Shared; // Its IRAM and code, NULL if none loaded
   union {
     UmmDpu U;  // UPMEM DPU
     RvDpu R;   // RISC-V DPU
   };
 };
 
+// Decoded programs cached on disk by binary, see prgCache.c. Load returns
+// the number of instructions, 0 if there is no fresh cache; it fills u or r
+// the way UmmPrgLoadBinary or RvPrgLoadBinary would.
+void DmmPrgCacheInit(const char *dir);
+size_t DmmPrgCacheLoad(const char *binPath, UmmPrg *u, RvPrg *r,
+                       DmmMap symbols, bool *paged);
+void DmmPrgCacheStore(const char *binPath, enum DmmDpuIs is, const void *iram,
+                      size_t nrInstr, const uint8_t *wma, DmmMap symbols,
+                      const bool *paged);
+
 #endif // DOWNMEM_H
@@ -13,8 +13,7 @@ typedef struct DmmDpu DmmDpu;
 
 /**
  * @brief The different synchronization methods for launching DPUs.
- * polling method to check whether the execution is complete or not.
- * NOT IMPLEMENTED YET!!!!
+ * With DPU_ASYNCHRONOUS, use `dpu_status` to poll or `dpu_sync` to wait.
  */
 typedef enum _dpu_launch_policy_t {
   /**
@@ -40,7 +39,6 @@ typedef enum _dpu_xfer_t {
 
 /**
  * @brief Options for a DPU memory transfer.
- * All equivalent to DPU_XFER_DEFAULT --- NOT IMPLEMENTED YET!!!!
  */
 typedef enum _dpu_xfer_flags_t {
   /** Memory transfer is executed and transfer buffer pointers are cleared. */
@@ -51,6 +49,9 @@ typedef enum _dpu_xfer_flags_t {
    * Memory transfer is done asynchronously. The application is given back the
    * control once the transfer is enqueue in the asynchronous job list of the
    * rank(s).
+   * Jobs run in submission order behind queued launches and transfers on the
+   * same DPUs. Host buffers must stay valid until `dpu_sync`; the transfer's
+   * `DmmDpuRecords` entry is filled in right away.
    */
   DPU_XFER_ASYNC = 1 << 1,
   /**
@@ -59,6 +60,11 @@ typedef enum _dpu_xfer_flags_t {
    *transfer only.
    * @warning there is no synchronization between the host and the DPU for this
    * transfer. The user needs to take care of it.
+   *
+   * A running DPU applies the transfer at its next logic cycle multiple of
+   * DmmPollNrCycle; DPUs not running are written at once. The call skips the
+   * job queue and returns once every DPU got the transfer. Its modeled time
+   * goes to DmmTotParallelXferUsec rather than DmmDpuRecords.
    **/
   DPU_XFER_PARALLEL = 1 << 2,
 } dpu_xfer_flags_t;
@@ -114,6 +120,9 @@ dpu_alloc_ranks(uint32_t nr_ranks, const char *noImpl, struct dpu_set_t *dpu_set
  * Note that this function will **cause undefined behavior** if called with a
  * DPU set not provided by `dpu_alloc`.
  *
+ * The simulator keeps the DPUs' memory images for later `dpu_load`s rather
+ * than returning them to the system.
+ *
  * @param dpu_set the identifier of the freed DPU set
  * @return Always DPU_OK for simulator
  */
@@ -172,21 +181,34 @@ dpu_error_t dpu_load(struct dpu_set_t dpu_set, const char *objdmp_path,
 
 /**
  * @brief Request the boot of all the DPUs in a DPU set.
+ *
+ * An asynchronous launch returns once the simulation is queued. Launches and
+ * DPU_XFER_ASYNC transfers on overlapping sets run in submission order; jobs
+ * on disjoint sets, from any host thread, run at once and share the
+ * simulation threads. Other calls that touch the DPUs of the set (synchronous
+ * transfers, loads, `dpu_free`) wait for the queued ones first. The launch's
+ * `DmmDpuRecords` entry is claimed at submission and filled in when the
+ * simulation completes.
  * @param dpu_set the identifier of the DPU set we want to boot
- * @param policy NOT IMPLEMENTED!!!! Always SYNCHRONOUS for now
+ * @param policy whether to wait for the DPUs to complete
  * @return Whether the operation was successful.
  */
-dpu_error_t dpu_launch(struct dpu_set_t dpu_set, dpu_launch_policy_t noImpl);
+dpu_error_t dpu_launch(struct dpu_set_t dpu_set, dpu_launch_policy_t policy);
 
-// NOT IMPLEMENTED! DPU sets are always done, always return success.
-static inline dpu_error_t
-dpu_status(struct dpu_set_t dpu_set, bool *done, bool *fault) {
-  if (done != NULL) *done = true;
-  if (fault != NULL) *fault = false;
-  return DPU_OK;
-}
-// NOT IMPLEMENTED! No-op for now
-static inline dpu_error_t dpu_sync(struct dpu_set_t dpu_set) { return DPU_OK; }
+/**
+ * @brief Check whether the DPUs of a set are done with their queued jobs.
+ * @param dpu_set the DPU set to check
+ * @param done whether no launch or transfer is queued on the set
+ * @param fault always false, faults are not simulated
+ * @return Always DPU_OK for simulator
+ */
+dpu_error_t dpu_status(struct dpu_set_t dpu_set, bool *done, bool *fault);
+/**
+ * @brief Wait for the queued launches and transfers on the DPUs of a set.
+ * @param dpu_set the DPU set to wait for
+ * @return Always DPU_OK for simulator
+ */
+dpu_error_t dpu_sync(struct dpu_set_t dpu_set);
 
 #define DPU_MRAM_HEAP_POINTER_NAME "__sys_used_mram_end"
 /**
@@ -0,0 +1,126 @@
+#include <dpu.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef NR_TASKLETS
+#define NR_TASKLETS 16
+#endif
+#define BLOCK_WORDS 64
+#define NR_REPS 2
+
+// Exercises DPU_ASYNCHRONOUS launches, DPU_XFER_ASYNC transfers queued around
+// them, dpu_status/dpu_sync, and DPU_XFER_PARALLEL transfers to running DPUs.
+// Usage: ./async <words_per_dpu> <nr_dpus> <binary_path>
+int main(int argc, char **argv) {
+  if (argc != 4) {
+    fprintf(stderr, "Usage: %s <words_per_dpu> <nr_dpus> <binary_path>\n",
+            argv[0]);
+    return 1;
+  }
+  struct dpu_set_t dpuSet, dpu;
+  uint32_t nrWords = atoi(argv[1]);
+  size_t nrDpus = atoi(argv[2]), i;
+  nrWords -= nrWords % (NR_TASKLETS * BLOCK_WORDS);
+  if (nrWords == 0)
+    nrWords = NR_TASKLETS * BLOCK_WORDS;
+  printf("Testing ASYNC: %u words per DPU, %zu DPUs\n", nrWords, nrDpus);
+
+  DPU_ASSERT(dpu_alloc(nrDpus, NULL, &dpuSet));
+  DPU_ASSERT(dpu_load(dpuSet, argv[3], NULL));
+  uint32_t *inputs = malloc((size_t)nrWords * nrDpus * sizeof(uint32_t));
+  uint32_t *devSums = malloc(nrDpus * NR_TASKLETS * sizeof(uint32_t));
+  uint32_t *summed = calloc(nrDpus, sizeof(uint32_t));
+  if (!inputs || !devSums || !summed) {
+    fprintf(stderr, "Memory allocation failed\n");
+    return 1;
+  }
+  srand(12345);
+  for (size_t w = 0; w < (size_t)nrWords * nrDpus; ++w)
+    inputs[w] = rand() % 1000;
+
+  DPU_ASSERT(dpu_broadcast_to(dpuSet, "nrWords", 0, &nrWords,
+                              sizeof(nrWords), DPU_XFER_DEFAULT));
+
+  size_t errors = 0;
+  for (uint32_t rep = 0; rep < NR_REPS; ++rep) {
+    const uint32_t zero = 0, bias = 1000 + rep;
+    // Not queued: parallel transfers below would see the last rep's flags
+    DPU_ASSERT(dpu_broadcast_to(dpuSet, "summed", 0, &zero, sizeof(zero),
+                                DPU_XFER_DEFAULT));
+    DPU_ASSERT(dpu_broadcast_to(dpuSet, "bias", 0, &zero, sizeof(zero),
+                                DPU_XFER_DEFAULT));
+    // The launch runs after the queued input transfer
+    DPU_FOREACH(dpuSet, dpu, i) {
+      DPU_ASSERT(dpu_prepare_xfer(dpu, inputs + (size_t)nrWords * i));
+    }
+    DPU_ASSERT(dpu_push_xfer(dpuSet, DPU_XFER_TO_DPU,
+                             DPU_MRAM_HEAP_POINTER_NAME, 0,
+                             nrWords * sizeof(uint32_t), DPU_XFER_ASYNC));
+    DPU_ASSERT(dpu_launch(dpuSet, DPU_ASYNCHRONOUS));
+    // Fills devSums only once the launch is over
+    memset(devSums, 0, nrDpus * NR_TASKLETS * sizeof(uint32_t));
+    DPU_FOREACH(dpuSet, dpu, i) {
+      DPU_ASSERT(dpu_prepare_xfer(dpu, devSums + NR_TASKLETS * i));
+    }
+    DPU_ASSERT(dpu_push_xfer(dpuSet, DPU_XFER_FROM_DPU, "sums", 0,
+                             NR_TASKLETS * sizeof(uint32_t), DPU_XFER_ASYNC));
+
+    // No DPU can finish before it gets its bias
+    bool done, fault;
+    DPU_ASSERT(dpu_status(dpuSet, &done, &fault));
+    if (done) {
+      printf("ERROR: rep %u done before the bias was posted\n", rep);
+      ++errors;
+    }
+    // Post the bias to each DPU once it has summed, while it keeps running.
+    // DPUs are polled one by one since a simulation thread may only get to a
+    // DPU after the ones before it have finished.
+    memset(summed, 0, nrDpus * sizeof(uint32_t));
+    for (size_t nrPosted = 0; nrPosted < nrDpus;) {
+      DPU_FOREACH(dpuSet, dpu, i) {
+        if (summed[i] == 2)
+          continue;
+        DPU_ASSERT(dpu_prepare_xfer(dpu, &summed[i]));
+        DPU_ASSERT(dpu_push_xfer(dpu, DPU_XFER_FROM_DPU, "summed", 0,
+                                 sizeof(uint32_t), DPU_XFER_PARALLEL));
+        if (summed[i] != 1)
+          continue;
+        DPU_ASSERT(dpu_prepare_xfer(dpu, (void *)&bias));
+        DPU_ASSERT(dpu_push_xfer(dpu, DPU_XFER_TO_DPU, "bias", 0,
+                                 sizeof(uint32_t), DPU_XFER_PARALLEL));
+        summed[i] = 2;
+        ++nrPosted;
+      }
+    }
+    DPU_ASSERT(dpu_sync(dpuSet));
+    DPU_ASSERT(dpu_status(dpuSet, &done, &fault));
+    if (!done) {
+      printf("ERROR: rep %u not done after dpu_sync\n", rep);
+      ++errors;
+    }
+
+    for (i = 0; i < nrDpus * NR_TASKLETS && errors < 10; ++i) {
+      const uint32_t *in = inputs + (size_t)i * (nrWords / NR_TASKLETS);
+      uint32_t expect = bias;
+      for (size_t w = 0; w < nrWords / NR_TASKLETS; ++w)
+        expect += in[w];
+      if (devSums[i] != expect) {
+        printf("ERROR rep %u at DPU %zu tasklet %zu: expected %u, got %u\n",
+               rep, i / NR_TASKLETS, i % NR_TASKLETS, expect, devSums[i]);
+        ++errors;
+      }
+    }
+  }
+
+  free(inputs);
+  free(devSums);
+  free(summed);
+  dpu_free(dpuSet);
+  if (errors != 0) {
+    printf("FAILED: %zu errors found\n", errors);
+    return 1;
+  }
+  printf("SUCCESS: %u reps of %zu DPUs match!\n", NR_REPS, nrDpus);
+  return 0;
+}
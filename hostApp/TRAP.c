@@ -0,0 +1,63 @@
+#include <dpu.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef NR_TASKLETS
+#define NR_TASKLETS 16
+#endif
+
+// Exercises DPU traps on the functional-only engines: odd tasklets abort()
+// and stop, leaving their sums zero, while the even ones run to the end.
+// Usage: ./trap <nr_iter> <nr_dpus> <binary_path>
+int main(int argc, char **argv) {
+  if (argc != 4) {
+    fprintf(stderr, "Usage: %s <nr_iter> <nr_dpus> <binary_path>\n", argv[0]);
+    return 1;
+  }
+  struct dpu_set_t dpuSet, dpu;
+  uint32_t nrIter = atoi(argv[1]);
+  size_t nrDpus = atoi(argv[2]), i;
+  printf("Testing TRAP: %u iterations, %zu DPUs\n", nrIter, nrDpus);
+
+  DPU_ASSERT(dpu_alloc(nrDpus, NULL, &dpuSet));
+  DPU_ASSERT(dpu_load(dpuSet, argv[3], NULL));
+  uint32_t *devSums = malloc(nrDpus * NR_TASKLETS * sizeof(uint32_t));
+  if (!devSums) {
+    fprintf(stderr, "Memory allocation failed\n");
+    return 1;
+  }
+  DPU_ASSERT(dpu_broadcast_to(dpuSet, "nrIter", 0, &nrIter, sizeof(nrIter),
+                              DPU_XFER_DEFAULT));
+  DPU_ASSERT(dpu_launch(dpuSet, DPU_SYNCHRONOUS));
+  memset(devSums, 0x42, nrDpus * NR_TASKLETS * sizeof(uint32_t));
+  DPU_FOREACH(dpuSet, dpu, i) {
+    DPU_ASSERT(dpu_prepare_xfer(dpu, devSums + NR_TASKLETS * i));
+  }
+  DPU_ASSERT(dpu_push_xfer(dpuSet, DPU_XFER_FROM_DPU, "sums", 0,
+                           NR_TASKLETS * sizeof(uint32_t), DPU_XFER_DEFAULT));
+
+  size_t errors = 0;
+  for (i = 0; i < nrDpus * NR_TASKLETS && errors < 10; ++i) {
+    uint32_t id = i % NR_TASKLETS, expect = 0;
+    if (!(id & 1)) {
+      expect = id;
+      for (uint32_t it = 0; it < nrIter; ++it)
+        expect += it ^ id;
+    }
+    if (devSums[i] != expect) {
+      printf("ERROR at DPU %zu tasklet %u: expected %u, got %u\n",
+             i / NR_TASKLETS, id, expect, devSums[i]);
+      ++errors;
+    }
+  }
+
+  free(devSums);
+  dpu_free(dpuSet);
+  if (errors != 0) {
+    printf("FAILED: %zu errors found\n", errors);
+    return 1;
+  }
+  printf("SUCCESS: %zu DPUs match!\n", nrDpus);
+  return 0;
+}
@@ -1,58 +1,121 @@
 #include "dmm_common.h"
 #include <stdlib.h>
 #include <assert.h>
+#include <limits.h>
 
 #define MIN(a, b) ((a) < (b) ? (a) : (b))
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
 
-// Dynamic array functions
+// Ring buffer functions. Entries are runs of identical commands; a DMA
+// becomes one run per row it touches instead of one entry per 8 bytes.
 static void _sliceinit(_memcmdSlice* arr) {
-  arr->capacity = 16;
+  arr->capacity = 64;
   arr->size = 0;
-  arr->offset = 0;
+  arr->head = 0;
   arr->data = (_memcmd*)malloc(arr->capacity * sizeof(_memcmd));
+  memset(arr->nrRunOfRow, 0, sizeof(arr->nrRunOfRow));
 }
-static inline _memcmd _get(_memcmdSlice* arr, size_t index) {
-  return arr->data[arr->offset + index];
+static inline _memcmd* _at(_memcmdSlice* arr, size_t index) {
+  return &arr->data[(arr->head + index) & (arr->capacity - 1)];
+}
+static inline uint32_t* _nrRunOfRow(_memcmdSlice* arr, long address) {
+  return &arr->nrRunOfRow[(address / WordlineSz) & (_memcmdNrRowHash - 1)];
 }
 static void _popfront(_memcmdSlice* arr) {
   assert(arr->size > 0);
-  arr->offset++;
+  --*_nrRunOfRow(arr, _at(arr, 0)->address);
+  arr->head = (arr->head + 1) & (arr->capacity - 1);
+  arr->size--;
+}
+static void _popback(_memcmdSlice* arr) {
+  assert(arr->size > 0);
+  --*_nrRunOfRow(arr, _at(arr, arr->size - 1)->address);
   arr->size--;
 }
+static inline bool _samecmd(const _memcmd* a, const _memcmd* b) {
+  return a->address == b->address && a->thrd_id == b->thrd_id;
+}
+
+// Make room for one more run
+static void _reserve(_memcmdSlice* arr) {
+  if (arr->size < arr->capacity)
+    return;
+  size_t new_capacity = arr->capacity * 2;
+  _memcmd* new_data = (_memcmd*)malloc(new_capacity * sizeof(_memcmd));
+  for (size_t i = 0; i < arr->size; i++)
+    new_data[i] = *_at(arr, i);
+  free(arr->data);
+  arr->data = new_data;
+  arr->capacity = new_capacity;
+  arr->head = 0;
+}
 
 static void _push(_memcmdSlice* arr, _memcmd cmd) {
-  // Check if we need to resize or compact
-  if (arr->offset + arr->size >= arr->capacity) {
-    // If more than half the array is unused due to offset, compact
-    if (arr->offset > arr->capacity / 2) {
-      memmove(arr->data, arr->data + arr->offset, arr->size * sizeof(_memcmd));
-      arr->offset = 0;
-    } else {
-      // Otherwise, resize
-      size_t new_capacity = arr->capacity * 2;
-      _memcmd* new_data = (_memcmd*)malloc(new_capacity * sizeof(_memcmd));
-      memcpy(new_data, arr->data + arr->offset, arr->size * sizeof(_memcmd));
-      free(arr->data);
-      arr->data = new_data;
-      arr->capacity = new_capacity;
-      arr->offset = 0;
-    }
+  if (arr->size != 0 && _samecmd(_at(arr, arr->size - 1), &cmd)) {
+    _at(arr, arr->size - 1)->nr += cmd.nr;
+    return;
   }
-  arr->data[arr->offset + arr->size] = cmd;
+  _reserve(arr);
+  *_at(arr, arr->size) = cmd;
   arr->size++;
+  ++*_nrRunOfRow(arr, cmd.address);
+}
+
+// Take one command off the front run
+static _memcmd _takefront(_memcmdSlice* arr) {
+  _memcmd* run = _at(arr, 0);
+  _memcmd cmd = {run->address, run->thrd_id, 1};
+  if (--run->nr == 0)
+    _popfront(arr);
+  return cmd;
+}
+
+// Put cmd in front of run index (0 < index <= size), merging with
+// neighbours. Runs before index move, as the scheduler only looks near the
+// front.
+static void _insert(_memcmdSlice* arr, size_t index, _memcmd cmd) {
+  if (_samecmd(_at(arr, index - 1), &cmd)) {
+    _at(arr, index - 1)->nr += cmd.nr;
+  } else if (index < arr->size && _samecmd(_at(arr, index), &cmd)) {
+    _at(arr, index)->nr += cmd.nr;
+  } else {
+    _reserve(arr);
+    arr->head = (arr->head - 1) & (arr->capacity - 1);
+    for (size_t i = 0; i < index; i++)
+      *_at(arr, i) = *_at(arr, i + 1);
+    *_at(arr, index) = cmd;
+    arr->size++;
+    ++*_nrRunOfRow(arr, cmd.address);
+  }
+}
+
+// Drop run index (0 < index), moving the runs before it
+static void _erase(_memcmdSlice* arr, size_t index) {
+  --*_nrRunOfRow(arr, _at(arr, index)->address);
+  for (size_t i = index; i > 0; i--)
+    *_at(arr, i) = *_at(arr, i - 1);
+  arr->head = (arr->head + 1) & (arr->capacity - 1);
+  arr->size--;
 }
 
+// Remove the first command of run index. Like removing one entry from a
+// per-command queue, the front command takes its place unless the removed
+// one was the very last.
 static _memcmd _rm(_memcmdSlice* arr, size_t index) {
   assert(index < arr->size);
-  _memcmd removed = arr->data[arr->offset + index];
-  if (index == arr->size - 1) {
-    arr->size--;
+  _memcmd* run = _at(arr, index);
+  _memcmd removed = {run->address, run->thrd_id, 1};
+  if (index == 0)
+    return _takefront(arr);
+  if (index == arr->size - 1 && run->nr == 1) {
+    _popback(arr);
     return removed;
   }
-  arr->data[arr->offset + index] = arr->data[arr->offset];
-  arr->data[arr->offset] = removed;
-  arr->offset++;
-  arr->size--;
+  _memcmd front = {_at(arr, 0)->address, _at(arr, 0)->thrd_id, 1};
+  if (--run->nr == 0)
+    _erase(arr, index);
+  _insert(arr, index, front);
+  _takefront(arr);
   return removed;
 }
 
@@ -75,6 +138,9 @@ void DmmMramTimingInit(DmmMramTiming* mt) {
   memset(mt->WaitIds, 0, sizeof(mt->WaitIds));
   memset(mt->AckLeft, 0, sizeof(mt->AckLeft));
 
+#ifdef __DMM_EVENT_DRIVEN
+  mt->NrIdle = 0;
+#endif
   mt->StatMemoryCycle = 0;
   mt->StatNrFr = 0;
   mt->StatNrFcfs = 0;
@@ -91,25 +157,33 @@ void DmmMramTimingPush(DmmMramTiming *mt, long begin_addr, long size,
   long end_addr = begin_addr + size;
   long ack_nr = 0;
 
-  for (long address = begin_addr & ~7l; address < end_addr; address += 8) {
-    _memcmd memory_command = {
-      .address = address / WordlineSz * WordlineSz, .thrd_id = thrd_id};
+  // One 8-byte command per word, grouped into one run per row
+  for (long address = begin_addr & ~7l; address < end_addr;) {
+    long row = address / WordlineSz * WordlineSz;
+    long nr = (MIN(end_addr, row + WordlineSz) - address + 7) / 8;
+    _memcmd memory_command = {.address = row, .thrd_id = thrd_id, .nr = nr};
     _push(&mt->ScheRob, memory_command);
-    ack_nr++;
+    address += nr * 8;
+    ack_nr += nr;
   }
 
   mt->AckLeft[thrd_id] = ack_nr;
   mt->WaitIds[mt->NrWait] = thrd_id;
   mt->NrWait++;
+#ifdef __DMM_EVENT_DRIVEN
+  mt->NrIdle = 0;
+#endif
 }
 
 static void _serveMramSched(DmmMramTiming* mt) {
-  if (mt->ScheRowAddr != noAddr) {
-    for (long i = 0; mt->ScheRob.size >= i + 1 && i < ReorderWinSz; i++) {
-      _memcmd memory_command = _get(&mt->ScheRob, i);
-      if (memory_command.address == mt->ScheRowAddr) {
-        _rm(&mt->ScheRob, i);
-        _push(&mt->ScheReadyQ, memory_command);
+  if (mt->ScheRowAddr != noAddr &&
+      *_nrRunOfRow(&mt->ScheRob, mt->ScheRowAddr) != 0) {
+    // Commands of a run are alike, so only a run's first one can match first
+    long i = 0;
+    for (size_t run = 0; run < mt->ScheRob.size && i < ReorderWinSz;
+         i += _at(&mt->ScheRob, run++)->nr) {
+      if (_at(&mt->ScheRob, run)->address == mt->ScheRowAddr) {
+        _push(&mt->ScheReadyQ, _rm(&mt->ScheRob, run));
         mt->StatNrFr++;
         return;
       }
@@ -117,8 +191,7 @@ static void _serveMramSched(DmmMramTiming* mt) {
   }
 
   if (mt->ScheRob.size >= 1) {
-    _memcmd memcmd = _get(&mt->ScheRob, 0);
-    _popfront(&mt->ScheRob);
+    _memcmd memcmd = _takefront(&mt->ScheRob);
     long wordline_addr = memcmd.address;
     _push(&mt->ScheReadyQ, memcmd);
     mt->ScheRowAddr = wordline_addr;
@@ -164,10 +237,8 @@ static void _serveRowBuf(DmmMramTiming* mt) {
 
 void DmmMramTimingCycle(DmmMramTiming* mt) {
   // Move scheduling results into row buffer
-  if (mt->RowbufInSlot.address == noAddr && mt->ScheReadyQ.size >= 1) {
-    mt->RowbufInSlot = _get(&mt->ScheReadyQ, 0);
-    _popfront(&mt->ScheReadyQ);
-  }
+  if (mt->RowbufInSlot.address == noAddr && mt->ScheReadyQ.size >= 1)
+    mt->RowbufInSlot = _takefront(&mt->ScheReadyQ);
 
   // Move fulfilled DMA memory requests into output
   for (long i = 0; i < mt->NrWait; i++) {
@@ -184,3 +255,162 @@ void DmmMramTimingCycle(DmmMramTiming* mt) {
   _serveRowBuf(mt);
   mt->StatMemoryCycle += 1;
 }
+
+#ifdef __DMM_EVENT_DRIVEN
+// Cycles until a counter that grows by one per cycle reaches threshold
+static long _untilAtLeast(long since, long threshold) {
+  return since >= threshold ? 0 : threshold - since;
+}
+
+// Cycles for which _serveMramSched does nothing or keeps moving row hits off
+// the front ROB run, one per cycle
+static long _schedStreamCycles(DmmMramTiming* mt) {
+  if (mt->ScheRob.size == 0)
+    return LONG_MAX;
+  _memcmd* front = _at(&mt->ScheRob, 0);
+  return front->address == mt->ScheRowAddr ? front->nr : 0;
+}
+
+// Number of upcoming cycles in which no command moves except for scheduler
+// row hits. Mirrors the conditions of DmmMramTimingCycle and _serveRowBuf.
+static long _idleCycles(DmmMramTiming* mt) {
+  long idle = _schedStreamCycles(mt);
+  if (idle == 0)
+    return 0;
+  if (mt->RowbufInSlot.address == noAddr) {
+    if (mt->ScheReadyQ.size != 0)
+      return 0;
+    // The first row hit refills the slot a cycle later
+    if (idle != LONG_MAX)
+      idle = 1;
+  }
+  for (long i = 0; i < mt->NrWait; i++)
+    if (mt->AckLeft[mt->WaitIds[i]] == 0)
+      return 0;
+
+  long inAddr = mt->RowbufInSlot.address;
+  if (inAddr != noAddr && inAddr == mt->RowbufAddr &&
+      mt->RowbufIoSlot.address == noAddr) {
+    idle = MIN(idle, _untilAtLeast(mt->RowbufPrechSince, TRp + 2 + TRcd));
+  } else if (inAddr != noAddr && inAddr != mt->RowbufAddr) {
+    long t = MAX(_untilAtLeast(mt->RowbufPrechSince, TRp + 2 + TRas),
+                 _untilAtLeast(mt->RowbufIoSince, TCl + 1));
+    idle = MIN(idle, MAX(t, _untilAtLeast(mt->RowbufBusSince, TBl + 1)));
+  }
+  if (mt->RowbufIoSlot.address != noAddr) {
+    long t = MAX(_untilAtLeast(mt->RowbufIoSince, TCl),
+                 _untilAtLeast(mt->RowbufBusSince, TBl + 1));
+    idle = MIN(idle, t);
+  }
+  if (mt->RowbufBusSince <= TBl)
+    idle = MIN(idle, TBl - mt->RowbufBusSince);
+  return idle;
+}
+
+// Advance nrCycle cycles found by _idleCycles
+static void _skipIdle(DmmMramTiming* mt, long nrCycle) {
+  if (mt->ScheRob.size != 0) {
+    _memcmd hits = *_at(&mt->ScheRob, 0);
+    hits.nr = nrCycle;
+    if ((_at(&mt->ScheRob, 0)->nr -= nrCycle) == 0)
+      _popfront(&mt->ScheRob);
+    _push(&mt->ScheReadyQ, hits);
+    mt->StatNrFr += nrCycle;
+  }
+  mt->RowbufPrechSince += nrCycle;
+  mt->RowbufBusSince += nrCycle;
+  mt->RowbufIoSince += nrCycle;
+  mt->StatMemoryCycle += nrCycle;
+}
+
+// Row hits of one tasklet stream through the row buffer with a fixed
+// period: a command leaves the IO slot for the bus, the next enters the IO
+// slot a cycle later, the slot is refilled one after that and the bus acks
+// TBl cycles after it started. Returns how many whole periods can be
+// taken at once from the start of the cycle in which a command goes to the
+// bus, limited to nrCycle cycles.
+enum { _streamPeriod = TCl + 1 };
+_Static_assert(TBl < TCl, "bus must ack before the next command is read");
+static long _streamPeriods(DmmMramTiming* mt, long nrCycle) {
+  long row = mt->RowbufAddr;
+  if (mt->RowbufIoSlot.address != row || mt->RowbufInSlot.address != row ||
+      mt->RowbufIoSince < TCl || mt->RowbufBusSince <= TBl ||
+      mt->RowbufPrechSince <= TRp + 1 + TRcd || mt->ScheReadyQ.size == 0)
+    return 0;
+  _memcmd* next = _at(&mt->ScheReadyQ, 0);
+  long id = next->thrd_id;
+  if (next->address != row || mt->RowbufIoSlot.thrd_id != id ||
+      mt->RowbufInSlot.thrd_id != id)
+    return 0;
+  for (long i = 0; i < mt->NrWait; i++)
+    if (mt->AckLeft[mt->WaitIds[i]] == 0)
+      return 0;
+  long nrPeriod = MIN(next->nr, nrCycle / _streamPeriod);
+  return MIN(nrPeriod, _schedStreamCycles(mt) / _streamPeriod);
+}
+
+static void _skipPeriods(DmmMramTiming* mt, long nrPeriod) {
+  long nrCycle = nrPeriod * _streamPeriod;
+  _memcmd* next = _at(&mt->ScheReadyQ, 0);
+  long id = next->thrd_id;
+  if ((next->nr -= nrPeriod) == 0)
+    _popfront(&mt->ScheReadyQ);
+  // Acks never reach zero: the two commands in the slots are still pending
+  mt->AckLeft[id] -= nrPeriod;
+  mt->StatNrAccess += nrPeriod;
+  mt->RowbufBusSlot = (_memcmd){noAddr, id, 1};
+  _skipIdle(mt, nrCycle);
+  mt->RowbufIoSince = TCl;
+  mt->RowbufBusSince = _streamPeriod;
+}
+
+// Stops after the cycle that acks a tasklet, returns the cycles run
+static long _runUntilAck(DmmMramTiming* mt, long nrCycle) {
+  long left = nrCycle;
+  while (left > 0) {
+    if (mt->NrIdle == 0)
+      mt->NrIdle = _idleCycles(mt);
+    if (mt->NrIdle == 0) {
+      long nrPeriod = _streamPeriods(mt, left);
+      if (nrPeriod > 0) {
+        _skipPeriods(mt, nrPeriod);
+        left -= nrPeriod * _streamPeriod;
+        continue;
+      }
+      DmmMramTimingCycle(mt);
+      left--;
+      if (DmmMramTimingCanPop(mt))
+        break;
+      continue;
+    }
+    long idle = MIN(mt->NrIdle, left);
+    _skipIdle(mt, idle);
+    mt->NrIdle -= idle;
+    left -= idle;
+  }
+  return nrCycle - left;
+}
+
+void DmmMramTimingRun(DmmMramTiming* mt, long nrCycle) {
+  while (nrCycle > 0)
+    nrCycle -= _runUntilAck(mt, nrCycle);
+}
+
+long DmmMramTimingRunToAck(DmmMramTiming* mt, double freqRatio,
+                           long totNrCycle) {
+  // Hand over many logic cycles at once, then finish the one the ack is in
+  enum { chunk = 64 };
+  for (long nrLogic = 0;; nrLogic += chunk) {
+    long nrCycle = 0;
+    for (long i = 0; i < chunk; i++)
+      nrCycle += DmmMramCyclesAt(freqRatio, totNrCycle + nrLogic + i);
+    long ran = _runUntilAck(mt, nrCycle);
+    if (!DmmMramTimingCanPop(mt))
+      continue;
+    while (ran > 0)
+      ran -= DmmMramCyclesAt(freqRatio, totNrCycle + nrLogic++);
+    DmmMramTimingRun(mt, -ran);
+    return nrLogic;
+  }
+}
+#endif
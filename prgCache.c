@@ -0,0 +1,249 @@
+#include "downmem.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// A decoded program as dpu_load leaves it, so that loading the same binary
+// again needs neither the objdump parser nor libelf. One file per binary:
+//   _pcHdr, IRAM, _pcSym[NrSym], names, page numbers[NrPage],
+//   then at the next 4096 byte boundary the initialized WMAram pages.
+// It is only used while the binary keeps the size, mtime and inode it had.
+enum { _pcVersion = 1 };
+typedef struct {
+  char Magic[8];
+  uint32_t Version, Is; // _pcVersion, enum DmmDpuIs
+  uint32_t InstrNrByte, NrOpcode; // Of the decoder that wrote it
+  uint32_t NrInstr, NrSym, NameNrByte, NrPage;
+  uint64_t SrcNrByte, SrcMtimeNsec, SrcIno, SrcDev;
+} _pcHdr;
+typedef struct {
+  uint32_t Val, NameAt, NameNrByte;
+} _pcSym;
+static const char _pcMagic[8] = "dmmprg\n";
+
+// Loaded files stay mapped, as symbol tables point to their names
+typedef struct _pcMapped {
+  struct _pcMapped *Next;
+  const uint8_t *At;
+  size_t NrByte;
+  char Path[];
+} _pcMapped;
+static struct {
+  pthread_mutex_t Mu;
+  const char *Dir; // NULL if not caching
+  _pcMapped *Mapped;
+} prgCache = {PTHREAD_MUTEX_INITIALIZER};
+
+void DmmPrgCacheInit(const char *dir) {
+  if (mkdir(dir, 0755) != 0 && errno != EEXIST) {
+    perror("program cache");
+    return;
+  }
+  prgCache.Dir = strdup(dir);
+}
+
+static inline size_t _pcPagesAt(const _pcHdr *h) {
+  size_t at = sizeof(_pcHdr) + (size_t)h->NrInstr * h->InstrNrByte +
+              h->NrSym * sizeof(_pcSym) + h->NameNrByte +
+              h->NrPage * sizeof(uint32_t);
+  return (at + 4095) & ~(size_t)4095;
+}
+static inline uint32_t _pcInstrNrByte(enum DmmDpuIs is) {
+  return is == RV_DPUIS ? sizeof(RvInstr) : sizeof(UmmInstr);
+}
+static inline uint32_t _pcNrOpcode(enum DmmDpuIs is) {
+  return is == RV_DPUIS ? RvNrOpcode : NrOpcode;
+}
+
+// Where the binary's cache lives: its base name and a hash of its full path
+static bool _pcPath(const char *binPath, char out[PATH_MAX]) {
+  char full[PATH_MAX];
+  if (prgCache.Dir == NULL || realpath(binPath, full) == NULL)
+    return false;
+  uint64_t hash = 0xcbf29ce484222325;
+  for (const char *c = full; *c != '\0'; ++c)
+    hash = (hash ^ (uint8_t)*c) * 0x100000001b3;
+  const char *base = strrchr(full, '/');
+  return snprintf(out, PATH_MAX, "%s/%s-%016llx.dmmprg", prgCache.Dir,
+                  base + 1, (unsigned long long)hash) < PATH_MAX;
+}
+
+static bool _pcFresh(const _pcHdr *h, const struct stat *src) {
+  return memcmp(h->Magic, _pcMagic, sizeof(_pcMagic)) == 0 &&
+         h->Version == _pcVersion &&
+         (h->Is == RV_DPUIS || h->Is == UMM_DPUIS) &&
+         h->InstrNrByte == _pcInstrNrByte(h->Is) &&
+         h->NrOpcode == _pcNrOpcode(h->Is) &&
+         h->NrInstr <= (h->Is == RV_DPUIS ? IramNrInstrR : IramNrInstr) &&
+         h->NrPage <= (h->Is == RV_DPUIS ? WMAINrPageR : WMAINrPage) &&
+         h->SrcNrByte == (uint64_t)src->st_size &&
+         h->SrcMtimeNsec == (uint64_t)src->st_mtim.tv_sec * 1000000000 +
+                            src->st_mtim.tv_nsec &&
+         h->SrcIno == src->st_ino && h->SrcDev == src->st_dev;
+}
+
+// Symbol names and page numbers within bounds. Pages come after them in the
+// file, so this runs once the file is known to be long enough for them.
+static bool _pcValid(const _pcHdr *h) {
+  const _pcSym *syms = (const _pcSym*)((const uint8_t*)(h + 1) +
+                                       (size_t)h->NrInstr * h->InstrNrByte);
+  const uint8_t *pageNrs = (const uint8_t*)(syms + h->NrSym) + h->NameNrByte;
+  for (uint32_t i = 0; i < h->NrSym; ++i)
+    if ((uint64_t)syms[i].NameAt + syms[i].NameNrByte > h->NameNrByte)
+      return false;
+  uint32_t nrPage = h->Is == RV_DPUIS ? WMAINrPageR : WMAINrPage;
+  for (uint32_t i = 0; i < h->NrPage; ++i) {
+    uint32_t pg;
+    memcpy(&pg, pageNrs + i * sizeof(pg), sizeof(pg));
+    if (pg >= nrPage)
+      return false;
+  }
+  return true;
+}
+
+// The binary's cache file mapped, NULL if there is none or it is stale
+static const _pcHdr *_pcMap(const char *binPath, const struct stat *src) {
+  char path[PATH_MAX];
+  if (!_pcPath(binPath, path))
+    return NULL;
+  pthread_mutex_lock(&prgCache.Mu);
+  for (_pcMapped *m = prgCache.Mapped; m != NULL; m = m->Next)
+    if (strcmp(m->Path, path) == 0 && _pcFresh((const _pcHdr*)m->At, src)) {
+      pthread_mutex_unlock(&prgCache.Mu);
+      return (const _pcHdr*)m->At;
+    }
+  pthread_mutex_unlock(&prgCache.Mu);
+
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return NULL;
+  struct stat st;
+  const uint8_t *at = MAP_FAILED;
+  if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(_pcHdr))
+    at = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (at == MAP_FAILED)
+    return NULL;
+  const _pcHdr *h = (const _pcHdr*)at;
+  if (!_pcFresh(h, src) ||
+      _pcPagesAt(h) + (size_t)h->NrPage * 4096 > (size_t)st.st_size ||
+      !_pcValid(h)) {
+    munmap((void*)at, st.st_size);
+    return NULL;
+  }
+  _pcMapped *m = malloc(sizeof(_pcMapped) + strlen(path) + 1);
+  m->At = at; m->NrByte = st.st_size;
+  strcpy(m->Path, path);
+  pthread_mutex_lock(&prgCache.Mu);
+  m->Next = prgCache.Mapped;
+  prgCache.Mapped = m;
+  pthread_mutex_unlock(&prgCache.Mu);
+  return h;
+}
+
+size_t DmmPrgCacheLoad(const char *binPath, UmmPrg *u, RvPrg *r,
+                       DmmMap symbols, bool *paged) {
+  struct stat src;
+  if (prgCache.Dir == NULL || stat(binPath, &src) != 0)
+    return 0;
+  const _pcHdr *h = _pcMap(binPath, &src);
+  if (h == NULL)
+    return 0;
+  const uint8_t *iram = (const uint8_t*)(h + 1);
+  const _pcSym *syms = (const _pcSym*)(iram + (size_t)h->NrInstr *
+                                       h->InstrNrByte);
+  const char *names = (const char*)(syms + h->NrSym);
+  const char *pageNrs = names + h->NameNrByte;
+  const uint8_t *pages = (const uint8_t*)h + _pcPagesAt(h);
+
+  uint8_t *wma;
+  if (h->Is == RV_DPUIS) {
+    RvPrgInit(r, -1);
+    r->Iram = RvIramAlloc(-1);
+    memcpy(r->Iram, iram, (size_t)h->NrInstr * h->InstrNrByte);
+    wma = r->WMAram;
+    memset(paged, 0, WMAINrPageR);
+  } else {
+    UmmPrgInit(u, -1);
+    u->Iram = UmmIramAlloc(-1);
+    memcpy(u->Iram, iram, (size_t)h->NrInstr * h->InstrNrByte);
+    wma = u->WMAram;
+    memset(paged, 0, WMAINrPage);
+  }
+  for (uint32_t i = 0; i < h->NrSym; ++i)
+    DmmMapAssign(symbols, names + syms[i].NameAt, syms[i].NameNrByte,
+                 syms[i].Val);
+  // Copied once per load; the DPUs then map or copy wma as for a parsed one
+  for (uint32_t i = 0; i < h->NrPage; ++i) {
+    uint32_t pg;
+    memcpy(&pg, pageNrs + i * sizeof(pg), sizeof(pg));
+    memcpy(wma + (size_t)pg * 4096, pages + (size_t)i * 4096, 4096);
+    paged[pg] = true;
+  }
+  return h->NrInstr;
+}
+
+void DmmPrgCacheStore(const char *binPath, enum DmmDpuIs is, const void *iram,
+                      size_t nrInstr, const uint8_t *wma, DmmMap symbols,
+                      const bool *paged) {
+  char path[PATH_MAX], tmp[PATH_MAX + 8];
+  struct stat src;
+  if (!_pcPath(binPath, path) || stat(binPath, &src) != 0)
+    return;
+  _pcHdr h = {.Version = _pcVersion, .Is = is,
+              .InstrNrByte = _pcInstrNrByte(is), .NrOpcode = _pcNrOpcode(is),
+              .NrInstr = nrInstr, .SrcNrByte = src.st_size,
+              .SrcMtimeNsec = (uint64_t)src.st_mtim.tv_sec * 1000000000 +
+                              src.st_mtim.tv_nsec,
+              .SrcIno = src.st_ino, .SrcDev = src.st_dev};
+  memcpy(h.Magic, _pcMagic, sizeof(_pcMagic));
+  size_t nrPage = is == RV_DPUIS ? WMAINrPageR : WMAINrPage;
+  for (size_t i = 0; i < nrPage; ++i)
+    h.NrPage += paged[i];
+  const void *name; size_t nameNrByte; uint_fast32_t val;
+  for (size_t at = 0; DmmMapIter(symbols, &at, &name, &nameNrByte, &val);) {
+    ++h.NrSym;
+    h.NameNrByte += nameNrByte;
+  }
+
+  // Written aside and renamed into place, so readers never see half of it
+  snprintf(tmp, sizeof(tmp), "%s.XXXXXX", path);
+  int fd = mkstemp(tmp);
+  if (fd < 0) {
+    perror("program cache");
+    return;
+  }
+  FILE *f = fdopen(fd, "wb");
+  fwrite(&h, sizeof(h), 1, f);
+  fwrite(iram, h.InstrNrByte, nrInstr, f);
+  uint32_t nameAt = 0;
+  for (size_t at = 0; DmmMapIter(symbols, &at, &name, &nameNrByte, &val);) {
+    _pcSym s = {val, nameAt, nameNrByte};
+    fwrite(&s, sizeof(s), 1, f);
+    nameAt += nameNrByte;
+  }
+  for (size_t at = 0; DmmMapIter(symbols, &at, &name, &nameNrByte, &val);)
+    fwrite(name, 1, nameNrByte, f);
+  for (uint32_t i = 0; i < nrPage; ++i)
+    if (paged[i])
+      fwrite(&i, sizeof(i), 1, f);
+  static const uint8_t zeros[4096];
+  size_t at = ftell(f);
+  fwrite(zeros, 1, _pcPagesAt(&h) - at, f);
+  for (size_t i = 0; i < nrPage; ++i)
+    if (paged[i])
+      fwrite(wma + i * 4096, 4096, 1, f);
+  bool ok = !ferror(f);
+  if (fclose(f) != 0 || !ok || rename(tmp, path) != 0) {
+    perror("program cache");
+    unlink(tmp);
+  }
+}
@@ -2,51 +2,30 @@
 set -xe
 cd "$(dirname "$0")"
 
+# hostBuild DIR [CMAKE_OPTION...] builds only the host apps, which then run the
+# DPU programs of build/
+hostBuild() {
+  rm -r "$1" || true
+  cmake -GNinja -DCMAKE_EXPORT_COMPILE_COMMANDS=ON -DCMAKE_BUILD_TYPE=Release \
+    -S. "-B$1" "-DCMAKE_C_COMPILER=$CC" -DDMM_UPMEM=OFF -DDMM_RV=OFF "${@:2}"
+  ninja -C "$1" all
+}
+
 if test -n "$1"; then
   rm -r build || true
   mkdir -p build
   cmake -GNinja -DCMAKE_EXPORT_COMPILE_COMMANDS=ON -DCMAKE_BUILD_TYPE=Release \
     -S. -Bbuild -DCMAKE_C_COMPILER="$1/bin/clang" -DDMM_UPMEM=ON -DDMM_RV=ON
   ninja -C build all dpuExamples
+  CC="$1/bin/clang"
+  # Functional only, runs the threaded code instead of the timing model
+  hostBuild build-func -DDMM_FUNCTIONAL_ONLY=ON
+  hostBuild build-jit -DDMM_FUNCTIONAL_ONLY=ON -DDMM_RV_JIT=ON
+  hostBuild build-spmd -DDMM_FUNCTIONAL_ONLY=ON -DDMM_SPMD=ON
   # use libomp from this llvm installation
   export LD_LIBRARY_PATH="$1/lib/x86_64-pc-linux-gnu:${LD_LIBRARY_PATH}"
 fi
 
-time build/dmmBS 5242880 640 build/devApp/objdumps/BS.objdump
-time build/dmmCOMPACT 15728640 2560 build/devApp/objdumps/COMPACT.objdump
-time build/dmmHST 31457280 1280 build/devApp/objdumps/HST.objdump
-time build/dmmGEMV 10240 2048 build/devApp/objdumps/GEMV.objdump
-time build/dmmMLP 1024 1024 build/devApp/objdumps/MLP.objdump
-time build/dmmNW 2000 1000 64 build/devApp/objdumps/NW.objdump
-time build/dmmOPDEMO 262144 512 build/devApp/objdumps/OPDEMO.objdump 3
-time build/dmmOPDEMOF 262144 512 build/devApp/objdumps/OPDEMOF.objdump 4
-time build/dmmRED 96000000 1600 build/devApp/objdumps/RED.objdump
-time build/dmmSCAN 96000000 1600 build/devApp/objdumps/SCAN.objdump
-time build/dmmSCAN 96000000 1600 build/devApp/objdumps/SCANSSA.objdump
-time build/dmmSPMV 44444 888 build/devApp/objdumps/SPMV.objdump
-time build/dmmTRNS 2000 200 build/devApp/objdumps/TRNS.objdump
-time build/dmmTS 655360 640 build/devApp/objdumps/TS.objdump
-time build/dmmUNI 100000 512 build/devApp/objdumps/UNI.objdump
-time build/dmmVA 15728640 2560 build/devApp/objdumps/VA.objdump
-
-time build/dmmBS 5242880 640 build/devApp/rvbins/BS
-time build/dmmCOMPACT 15728640 2560 build/devApp/rvbins/COMPACT
-time build/dmmHST 31457280 1280 build/devApp/rvbins/HST
-time build/dmmHST 31457280 1280 build/devApp/rvbins/HSTS
-time build/dmmGEMV 10240 2048 build/devApp/rvbins/GEMV
-time build/dmmMLP 1024 1024 build/devApp/rvbins/MLP
-time build/dmmNW 2000 1000 64 build/devApp/rvbins/NW
-time build/dmmOPDEMO 262144 512 build/devApp/rvbins/OPDEMO 3
-time build/dmmOPDEMOF 262144 512 build/devApp/rvbins/OPDEMOF 4
-time build/dmmRED 96000000 1600 build/devApp/rvbins/RED
-time build/dmmSCAN 96000000 1600 build/devApp/rvbins/SCAN
-time build/dmmSCAN 96000000 1600 build/devApp/rvbins/SCANSSA
-time build/dmmSPMV 44444 888 build/devApp/rvbins/SPMV
-time build/dmmTRNS 2000 200 build/devApp/rvbins/TRNS
-time build/dmmTS 655360 640 build/devApp/rvbins/TS
-time build/dmmUNI 100000 512 build/devApp/rvbins/UNI
-time build/dmmVA 15728640 2560 build/devApp/rvbins/VA
-
 if ! [ -f hostApp/BFS/csr.txt ]; then
   wget -O hostApp/BFS/csr.txt.zst \
     "https://drive.usercontent.google.com/download?id=1bXYWq_4dXrJcst5jsLL3CJTeZTQCrBlr&export=download"
@@ -54,10 +33,72 @@ if ! [ -f hostApp/BFS/csr.txt ]; then
 fi
 build/dmmBFS simpleBFSCpu 0 hostApp/BFS/csr.txt /tmp/dmmBfsCOut >/dev/null
 
-time build/dmmBFS simpleBFSDpu 0 hostApp/BFS/csr.txt /tmp/dmmBfsDOut \
-  build/devApp/objdumps/BFS.objdump 192 
-diff /tmp/dmmBfs{C,D}Out # Check the output is indeed correct here.
-time build/dmmBFS simpleBFSDpu 0 hostApp/BFS/csr.txt /tmp/dmmBfsDOut \
-  build/devApp/rvbins/BFS 192
-diff /tmp/dmmBfs{C,D}Out # Another check for umm rv
+# ummApps DIR runs the host apps built in DIR on the UPMEM programs
+ummApps() {
+  time $1/dmmBS 5242880 640 build/devApp/objdumps/BS.objdump
+  time $1/dmmCOMPACT 15728640 2560 build/devApp/objdumps/COMPACT.objdump
+  time $1/dmmHST 31457280 1280 build/devApp/objdumps/HST.objdump
+  time $1/dmmGEMV 10240 2048 build/devApp/objdumps/GEMV.objdump
+  time $1/dmmMLP 1024 1024 build/devApp/objdumps/MLP.objdump
+  time $1/dmmNW 2000 1000 64 build/devApp/objdumps/NW.objdump
+  time $1/dmmOPDEMO 262144 512 build/devApp/objdumps/OPDEMO.objdump 3
+  time $1/dmmOPDEMOF 262144 512 build/devApp/objdumps/OPDEMOF.objdump 4
+  time $1/dmmRED 96000000 1600 build/devApp/objdumps/RED.objdump
+  time $1/dmmSCAN 96000000 1600 build/devApp/objdumps/SCAN.objdump
+  time $1/dmmSCAN 96000000 1600 build/devApp/objdumps/SCANSSA.objdump
+  time $1/dmmSPMV 44444 888 build/devApp/objdumps/SPMV.objdump
+  time $1/dmmTRNS 2000 200 build/devApp/objdumps/TRNS.objdump
+  time $1/dmmTS 655360 640 build/devApp/objdumps/TS.objdump
+  time $1/dmmUNI 100000 512 build/devApp/objdumps/UNI.objdump
+  time $1/dmmVA 15728640 2560 build/devApp/objdumps/VA.objdump
+  time $1/dmmASYNC 65536 512 build/devApp/objdumps/ASYNC.objdump
+  time $1/dmmBFS simpleBFSDpu 0 hostApp/BFS/csr.txt /tmp/dmmBfsDOut \
+    build/devApp/objdumps/BFS.objdump 192
+  diff /tmp/dmmBfs{C,D}Out # Check the output is indeed correct here.
+}
+# rvApps DIR runs them on the riscv programs
+rvApps() {
+  time $1/dmmBS 5242880 640 build/devApp/rvbins/BS
+  time $1/dmmCOMPACT 15728640 2560 build/devApp/rvbins/COMPACT
+  time $1/dmmHST 31457280 1280 build/devApp/rvbins/HST
+  time $1/dmmHST 31457280 1280 build/devApp/rvbins/HSTS
+  time $1/dmmGEMV 10240 2048 build/devApp/rvbins/GEMV
+  time $1/dmmMLP 1024 1024 build/devApp/rvbins/MLP
+  time $1/dmmNW 2000 1000 64 build/devApp/rvbins/NW
+  time $1/dmmOPDEMO 262144 512 build/devApp/rvbins/OPDEMO 3
+  time $1/dmmOPDEMOF 262144 512 build/devApp/rvbins/OPDEMOF 4
+  time $1/dmmRED 96000000 1600 build/devApp/rvbins/RED
+  time $1/dmmSCAN 96000000 1600 build/devApp/rvbins/SCAN
+  time $1/dmmSCAN 96000000 1600 build/devApp/rvbins/SCANSSA
+  time $1/dmmSPMV 44444 888 build/devApp/rvbins/SPMV
+  time $1/dmmTRNS 2000 200 build/devApp/rvbins/TRNS
+  time $1/dmmTS 655360 640 build/devApp/rvbins/TS
+  time $1/dmmUNI 100000 512 build/devApp/rvbins/UNI
+  time $1/dmmVA 15728640 2560 build/devApp/rvbins/VA
+  time $1/dmmASYNC 65536 512 build/devApp/rvbins/ASYNC
+  time $1/dmmBFS simpleBFSDpu 0 hostApp/BFS/csr.txt /tmp/dmmBfsDOut \
+    build/devApp/rvbins/BFS 192
+  diff /tmp/dmmBfs{C,D}Out # Another check for umm rv
+}
+ummApps build
+rvApps build
+ummApps build-func
+rvApps build-func
+rvApps build-jit
+rvApps build-spmd
+# Trapping tasklets stop there, while the timing model runs on past the trap
+time build-func/dmmTRAP 100000 16 build/devApp/rvbins/TRAP
+time build-jit/dmmTRAP 100000 16 build/devApp/rvbins/TRAP
+# Two DPUs leave six of eight simulation threads idle, so each DPU's tasklets
+# run on four host threads
+export DMM_NR_SIM_THRDS=8
+time build-func/dmmRED 120000 2 build/devApp/rvbins/RED
+time build-func/dmmSCAN 120000 2 build/devApp/rvbins/SCAN
+time build-func/dmmSCAN 120000 2 build/devApp/rvbins/SCANSSA
+time build-func/dmmHST 49152 2 build/devApp/rvbins/HST
+time build-func/dmmHST 49152 2 build/devApp/rvbins/HSTS
+time build-func/dmmVA 12288 2 build/devApp/rvbins/VA
+time build-func/dmmASYNC 65536 2 build/devApp/rvbins/ASYNC
+time build-func/dmmTRAP 100000 2 build/devApp/rvbins/TRAP
+unset DMM_NR_SIM_THRDS
 rm /tmp/dmmBfs{C,D}Out
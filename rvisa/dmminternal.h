@@ -57,26 +57,40 @@ typedef enum {
 
 // --- RISC-V Instruction Struct ---
 typedef struct RvInstr {
-  RvOpcode Opcode;
+  uint8_t Opcode; // RvOpcode
   uint8_t rd;  // Destination register (0-31)
   uint8_t rs1; // Source register 1 (0-31)
   uint8_t rs2; // Source register 2 (0-31)
   // Immediate value (offset in some instructions, sign extended)
   int32_t imm;
 } RvInstr;
+_Static_assert(sizeof(RvInstr) == 8, "RvInstr should stay packed");
+
+// --- Threaded-code instruction (functional-only fast path) ---
+typedef struct RvTcInstr {
+  const void *Handler;     // Label of the handler in RvDpuRunTc
+  int32_t imm;             // Branch/jump target as IRAM index; lui/auipc value
+  uint8_t rd, rs1, rs2;
+} RvTcInstr;
 
 // --- Program Struct ---
 typedef struct RvPrg {
   uint8_t* WMAram;         // Working memory + MRAM
-  RvInstr* Iram;         // Instruction memory (binary instructions)
+  RvInstr* Iram;         // Decoded instructions, shared per NUMA node, not owned
+  const RvTcInstr* Tc;   // Threaded code shared by all DPUs of a load, or NULL
+  const struct RvJit* Jit; // Host code shared by all DPUs of a load, or NULL
 } RvPrg;
 enum {
-  _WMAINrByteR = WramSizeR + MramSizeR + IramNrInstrR * sizeof(RvInstr),
+  _WMAINrByteR = WramSizeR + MramSizeR,
   WMAINrPageR = (_WMAINrByteR + 4095) / 4096,
-  WMAINrByteR = WMAINrPageR * 4096
+  WMAINrByteR = WMAINrPageR * 4096,
+  RvIramNrByte = IramNrInstrR * sizeof(RvInstr)
 };
 void RvPrgInit(RvPrg* p, int numaNode);
 void RvPrgFini(RvPrg* p);
+// Allocate a zeroed IRAM on numaNode (any node if negative) and free it
+RvInstr* RvIramAlloc(int numaNode);
+void RvIramFree(RvInstr* iram);
 // Binary instruction loading instead of objdump parsing
 size_t RvPrgLoadBinary(RvPrg *p, const char *filename, DmmMap symbols,
                        bool paged[WMAINrPageR]);
@@ -127,6 +141,7 @@ typedef struct RvTiming {
   // track whether each tasklet is ready to execute
   long lastIssue;
   long lastRunAt[MaxNumTasklets];
+  DmmRevolver revolver; // Slots of lastRunAt still in the window
 #ifdef __DMM_TSCDUMP
   // track each instructions' tsc (cycles each instruction takes)
   size_t lastPc[MaxNumTasklets];
@@ -145,11 +160,37 @@ static inline void RvTimingFini(RvTiming* t) {
 typedef struct RvDpu {
   RvPrg Program;
   RvTiming Timing;
+  DmmMailbox Mailbox;
 } RvDpu;
 
 void RvDpuInit(RvDpu* d, size_t memFreq, size_t logicFreq, int numaNode);
 void RvDpuRun(RvDpu* d, size_t nrTasklets);
+// RvDpuRun in pieces, so that one thread can interleave several DPUs: start,
+// then step until it returns false. A step stops at the first cycle (executed
+// instruction when functional only) at or past stopAt, or runs threaded or
+// JIT code to the end.
+void RvDpuStart(RvDpu* d, size_t nrTasklets);
+bool RvDpuStep(RvDpu* d, size_t nrTasklets, long stopAt);
+// Bring the state a step starts with into cache
+void RvDpuPrefetch(const RvDpu* d);
 void RvDpuExecuteInstr(RvDpu* d, RvTlet* thread);
+// Translate a decoded IRAM into threaded code (IramNrInstrR + 1 entries,
+// free()'d by the caller) and run it. Functional-only: no timing is modeled.
+RvTcInstr* RvTcBuild(const RvInstr* iram);
+void RvDpuRunTc(RvDpu* d, size_t nrTasklets);
+// RvDpuRun with the tasklets split among nrThrd host threads, the caller
+// being one, sharing WMAram and CSRs. Threaded code only; otherwise, or with
+// one thread, this is RvDpuRun. Tasklets interleave as the host schedules.
+void RvDpuRunPar(RvDpu* d, size_t nrTasklets, size_t nrThrd);
+// x86-64 JIT (DMM_RV_JIT). Functional-only as well.
+typedef struct RvJit RvJit;
+RvJit* RvJitBuild(const RvInstr* iram);
+void RvJitFree(RvJit* j);
+void RvDpuRunJit(RvDpu* d, size_t nrTasklets);
+// SPMD lockstep (DMM_SPMD), functional only as well: run nrDpu DPUs loaded
+// with the same program side by side, each as RvDpuRun without threaded code
+enum { RvSpmdNrLane = 8 };
+void RvDpuRunSpmd(RvDpu* const* dpus, size_t nrDpu, size_t nrTasklets);
 static inline void RvDpuFini(RvDpu* d) {
   RvPrgFini(&d->Program);
   RvTimingFini(&d->Timing);
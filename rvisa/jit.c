@@ -0,0 +1,401 @@
+#include "dmminternal.h"
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+
+// x86-64 template JIT for functional-only simulation. Every IRAM instruction
+// is translated once per dpu_load into host code; all DPUs of the set share it.
+// Register conventions inside generated code:
+//   rbx = Regs of the running tasklet   r12 = WMAram
+//   r13 = RvJitCtx                      r14 = executed instruction counter
+//   r15 = entry table (IRAM index -> host code)   ebp = backward-jump budget
+// CSR instructions except me() and DMA leave generated code and are executed
+// by RvDpuExecuteInstr, so tasklet switching happens only there (or once the
+// budget runs out, which keeps memory-polling loops live).
+
+enum {
+  JitCsr = 1, JitResume = 2, JitTrap = 3, // exit reason, in bits 16+ of eax
+  JitBudget = 1 << 14,
+  JitMaxInstrBytes = 96,
+  JitCodeBytes = (IramNrInstrR + 1) * JitMaxInstrBytes + 256,
+};
+
+typedef struct RvJitCtx {
+  long NrExec;
+  long Budget;
+  const void *const *Entry;
+} RvJitCtx;
+typedef uint32_t (*rvJitEnterFn)(uint32_t *regs, uint8_t *wm, RvJitCtx *ctx,
+                                 const void *target);
+
+struct RvJit {
+  uint8_t *Code;
+  rvJitEnterFn Enter;
+  const void *Entry[IramNrInstrR + 1];
+};
+
+static void rvJitDma(uint8_t *wm, uint32_t mram, uint32_t v) {
+  uint8_t *wramAddr = wm + (v >> 16);
+  uint8_t *mramAddr = wm + WramSizeR + ((mram - MramBeginR) & MramMaskR);
+  memcpy((v & 32768) ? mramAddr : wramAddr, (v & 32768) ? wramAddr : mramAddr,
+         v & 32767);
+}
+
+// --- Emitter ---
+typedef struct { uint8_t *Buf; size_t Len; } jitBuf;
+static inline void e1(jitBuf *b, uint8_t x) { b->Buf[b->Len++] = x; }
+static inline void e4(jitBuf *b, uint32_t x) {
+  memcpy(b->Buf + b->Len, &x, 4); b->Len += 4;
+}
+static inline void e8(jitBuf *b, uint64_t x) {
+  memcpy(b->Buf + b->Len, &x, 8); b->Len += 8;
+}
+static void eb(jitBuf *b, const char *bytes, size_t n) {
+  memcpy(b->Buf + b->Len, bytes, n); b->Len += n;
+}
+#define EB(b, s) eb(b, s, sizeof(s) - 1)
+
+// x86 GPR numbers used below
+enum { EAX = 0, ECX = 1, EDX = 2, ESI = 6 };
+// mov r32, [rbx + 4*rv]
+static void ldReg(jitBuf *b, int r, int rv) {
+  e1(b, 0x8B); e1(b, 0x43 | r << 3); e1(b, rv * 4);
+}
+// mov [rbx + 4*rv], r32
+static void stReg(jitBuf *b, int rv, int r) {
+  e1(b, 0x89); e1(b, 0x43 | r << 3); e1(b, rv * 4);
+}
+// mov dword [rbx + 4*rv], imm32
+static void stImm(jitBuf *b, int rv, uint32_t imm) {
+  e1(b, 0xC7); e1(b, 0x43); e1(b, rv * 4); e4(b, imm);
+}
+// Short forward jumps: emit with a placeholder, then bind to the current end
+static size_t j8(jitBuf *b, uint8_t op) { e1(b, op); e1(b, 0); return b->Len; }
+static void bind8(jitBuf *b, size_t at) { b->Buf[at - 1] = b->Len - at; }
+// 32-bit jumps to IRAM targets are patched once all entries are known
+typedef struct { uint32_t At, Target; } jitFixup;
+
+// eax = WMAram offset of vs1 + imm, folding MRAM addresses next to WRAM
+static void memAddr(jitBuf *b, const RvInstr *in) {
+  ldReg(b, EAX, in->rs1);
+  e1(b, 0x05); e4(b, in->imm);                      // add eax, imm
+  e1(b, 0x8D); e1(b, 0x88); e4(b, WramSizeR - MramBeginR); // lea ecx,[rax+d]
+  e1(b, 0x3D); e4(b, WramSizeR);                    // cmp eax, WramSizeR
+  EB(b, "\x0F\x43\xC1");                            // cmovae eax, ecx
+}
+
+static void emitExit(jitBuf *b, uint32_t code, size_t exitAt) {
+  e1(b, 0xB8); e4(b, code);                         // mov eax, code
+  e1(b, 0xE9); e4(b, exitAt - (b->Len + 4));        // jmp exit
+}
+
+// Jump to IRAM index `tgt`; backward jumps consume budget
+static void emitJump(jitBuf *b, size_t self, uint32_t tgt, size_t exitAt,
+                     jitFixup *fix, size_t *nrFix, const size_t *entryAt) {
+  if (tgt <= self) {
+    EB(b, "\xFF\xCD");                              // dec ebp
+    EB(b, "\x0F\x85"); e4(b, entryAt[tgt] - (b->Len + 4)); // jnz target
+    emitExit(b, JitResume << 16 | tgt, exitAt);
+  } else {
+    e1(b, 0xE9); e4(b, 0);
+    fix[(*nrFix)++] = (jitFixup){b->Len - 4, tgt};
+  }
+}
+
+RvJit *RvJitBuild(const RvInstr *iram) {
+  static_assert(offsetof(RvTlet, Regs) == 8, "Id is read at Regs - 8");
+  RvJit *j = malloc(sizeof(RvJit));
+  jitFixup *fix = malloc(IramNrInstrR * sizeof(jitFixup));
+  size_t *entryAt = malloc((IramNrInstrR + 1) * sizeof(size_t)), nrFix = 0;
+  uint8_t *code = mmap(NULL, JitCodeBytes, PROT_READ | PROT_WRITE,
+                       MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+  if (j == NULL || fix == NULL || entryAt == NULL || code == MAP_FAILED) {
+    perror("RvJitBuild");
+    exit(EXIT_FAILURE);
+  }
+  jitBuf bb = {code, 0}, *b = &bb;
+
+  // uint32_t enter(regs, wm, ctx, target)
+  EB(b, "\x53\x55\x41\x54\x41\x55\x41\x56\x41\x57"); // push rbx..r15
+  EB(b, "\x48\x83\xEC\x08");                        // sub rsp, 8
+  EB(b, "\x48\x89\xFB\x49\x89\xF4\x49\x89\xD5");    // rbx, r12, r13 = args
+  EB(b, "\x4D\x8B\x75\x00");                        // mov r14, [r13]
+  EB(b, "\x41\x8B\x6D\x08");                        // mov ebp, [r13+8]
+  EB(b, "\x4D\x8B\x7D\x10");                        // mov r15, [r13+16]
+  EB(b, "\xFF\xE1");                                // jmp rcx
+  size_t exitAt = b->Len;
+  EB(b, "\x4D\x89\x75\x00");                        // mov [r13], r14
+  EB(b, "\x48\x83\xC4\x08");                        // add rsp, 8
+  EB(b, "\x41\x5F\x41\x5E\x41\x5D\x41\x5C\x5D\x5B\xC3"); // pop r15..rbx; ret
+  entryAt[IramNrInstrR] = b->Len;
+  emitExit(b, JitTrap << 16 | IramNrInstrR, exitAt);
+
+  for (size_t i = 0; i < IramNrInstrR; ++i) {
+    const RvInstr *in = &iram[i];
+    uint32_t pc = IramBeginR + i * InstrNrByteR, rd = in->rd;
+    entryAt[i] = b->Len;
+    // CSR accesses other than me() and DMA leave to the dispatcher uncounted
+    if (in->Opcode >= CSRRW && in->Opcode <= CSRRCI &&
+        !(in->Opcode == CSRRW && in->imm % NrCsr == 3) &&
+        !(in->Opcode == CSRRSI && in->imm % NrCsr == 20 && in->rs1 == 0)) {
+      emitExit(b, JitCsr << 16 | i, exitAt);
+      continue;
+    }
+    if (in->Opcode == ECALL || in->Opcode == EBREAK || in->Opcode == REV8 ||
+        in->Opcode == ORC_B) {
+      emitExit(b, JitTrap << 16 | i, exitAt);
+      continue;
+    }
+    EB(b, "\x49\xFF\xC6");                          // inc r14
+    // Everything before stores only writes rd; with x0 these are no-ops
+    if (rd == 0 && in->Opcode < SBr)
+      continue;
+
+    switch (in->Opcode) {
+    case ADDr: case SUBr: case ANDr: case ORr: case XORr: case SLT: case SLTU:
+    case SLL: case SRL: case SRA: case ROLr: case RORr: case MUL:
+    case MIN: case MAXr: case MINU: case MAXU: case ANDNr: case ORNr:
+    case XNOR:
+      ldReg(b, EAX, in->rs1); ldReg(b, ECX, in->rs2);
+      switch (in->Opcode) {
+      case ADDr: EB(b, "\x01\xC8"); break;
+      case SUBr: EB(b, "\x29\xC8"); break;
+      case ANDr: EB(b, "\x21\xC8"); break;
+      case ORr:  EB(b, "\x09\xC8"); break;
+      case XORr: EB(b, "\x31\xC8"); break;
+      case SLT:  EB(b, "\x39\xC8\x0F\x9C\xC0\x0F\xB6\xC0"); break;
+      case SLTU: EB(b, "\x39\xC8\x0F\x92\xC0\x0F\xB6\xC0"); break;
+      case SLL:  EB(b, "\xD3\xE0"); break;
+      case SRL:  EB(b, "\xD3\xE8"); break;
+      case SRA:  EB(b, "\xD3\xF8"); break;
+      case ROLr: EB(b, "\xD3\xC0"); break;
+      case RORr: EB(b, "\xD3\xC8"); break;
+      case MUL:  EB(b, "\x0F\xAF\xC1"); break;
+      case MIN:  EB(b, "\x39\xC8\x0F\x4F\xC1"); break; // cmovg
+      case MAXr: EB(b, "\x39\xC8\x0F\x4C\xC1"); break; // cmovl
+      case MINU: EB(b, "\x39\xC8\x0F\x47\xC1"); break; // cmova
+      case MAXU: EB(b, "\x39\xC8\x0F\x42\xC1"); break; // cmovb
+      case ANDNr: EB(b, "\xF7\xD1\x21\xC8"); break;
+      case ORNr: EB(b, "\xF7\xD1\x09\xC8"); break;
+      case XNOR: EB(b, "\x31\xC8\xF7\xD0"); break;
+      default: __builtin_unreachable();
+      }
+      stReg(b, rd, EAX);
+      break;
+
+    case MULH: case MULHSU: case MULHU:
+      // rax = vs1, rcx = vs2; movsxd for signed operands, mov zero-extends
+      if (in->Opcode == MULHU) ldReg(b, EAX, in->rs1);
+      else { EB(b, "\x48\x63\x43"); e1(b, in->rs1 * 4); }
+      if (in->Opcode != MULH) ldReg(b, ECX, in->rs2);
+      else { EB(b, "\x48\x63\x4B"); e1(b, in->rs2 * 4); }
+      EB(b, "\x48\x0F\xAF\xC1\x48\xC1\xE8\x20");    // imul rax,rcx; shr rax,32
+      stReg(b, rd, EAX);
+      break;
+
+    case DIV: case DIVU: case REM: case REMU: {
+      bool isRem = in->Opcode == REM || in->Opcode == REMU;
+      size_t zero, done, done2 = 0, m1 = 0;
+      ldReg(b, EAX, in->rs1); ldReg(b, ECX, in->rs2);
+      EB(b, "\x85\xC9"); zero = j8(b, 0x74);        // test ecx,ecx; jz
+      if (in->Opcode == DIV || in->Opcode == REM) {
+        EB(b, "\x83\xF9\xFF"); m1 = j8(b, 0x74);    // cmp ecx,-1; je
+        EB(b, "\x99\xF7\xF9");                      // cdq; idiv ecx
+      } else {
+        EB(b, "\x31\xD2\xF7\xF1");                  // xor edx,edx; div ecx
+      }
+      if (isRem) EB(b, "\x89\xD0");                 // mov eax, edx
+      done = j8(b, 0xEB);
+      if (m1 != 0) {
+        // INT_MIN / -1 wraps back to INT_MIN, INT_MIN % -1 is 0
+        bind8(b, m1);
+        if (isRem) EB(b, "\x31\xC0"); else EB(b, "\xF7\xD8");
+        done2 = j8(b, 0xEB);
+      }
+      bind8(b, zero);
+      if (!isRem) EB(b, "\xB8\xFF\xFF\xFF\xFF");    // x / 0 = -1; x % 0 = x
+      bind8(b, done);
+      if (done2 != 0) bind8(b, done2);
+      stReg(b, rd, EAX);
+      break;
+    }
+
+    case CLZr: case CTZ: case CPOP:
+      ldReg(b, EAX, in->rs1);
+      e1(b, 0xF3); e1(b, 0x0F);
+      e1(b, in->Opcode == CLZr ? 0xBD : in->Opcode == CTZ ? 0xBC : 0xB8);
+      e1(b, 0xC0);
+      stReg(b, rd, EAX);
+      break;
+    case SEXT_B: case SEXT_H: case ZEXT_H:
+      e1(b, 0x0F);
+      e1(b, in->Opcode == SEXT_B ? 0xBE : in->Opcode == SEXT_H ? 0xBF : 0xB7);
+      e1(b, 0x43); e1(b, in->rs1 * 4);
+      stReg(b, rd, EAX);
+      break;
+
+    case ADDI: case ANDI: case ORI: case XORI: case SLTI: case SLTIU:
+      ldReg(b, EAX, in->rs1);
+      switch (in->Opcode) {
+      case ADDI: e1(b, 0x05); break;
+      case ANDI: e1(b, 0x25); break;
+      case ORI:  e1(b, 0x0D); break;
+      case XORI: e1(b, 0x35); break;
+      default:   e1(b, 0x3D); break;                // cmp eax, imm
+      }
+      e4(b, in->imm);
+      if (in->Opcode == SLTI) EB(b, "\x0F\x9C\xC0\x0F\xB6\xC0");
+      if (in->Opcode == SLTIU) EB(b, "\x0F\x92\xC0\x0F\xB6\xC0");
+      stReg(b, rd, EAX);
+      break;
+    case SLLI: case SRLI: case SRAI: case RORI:
+      ldReg(b, EAX, in->rs1);
+      e1(b, 0xC1);
+      e1(b, in->Opcode == SLLI ? 0xE0 : in->Opcode == SRLI ? 0xE8 :
+            in->Opcode == SRAI ? 0xF8 : 0xC8);
+      e1(b, in->imm & 0x1F);
+      stReg(b, rd, EAX);
+      break;
+    case LUI: stImm(b, rd, in->imm); break;
+    case AUIPC: stImm(b, rd, pc + in->imm); break;
+
+    case LBr: case LHr: case LWr: case LBUr: case LHUr:
+      memAddr(b, in);
+      switch (in->Opcode) {                         // op eax, [r12+rax]
+      case LBr:  EB(b, "\x41\x0F\xBE\x04\x04"); break;
+      case LHr:  EB(b, "\x41\x0F\xBF\x04\x04"); break;
+      case LWr:  EB(b, "\x41\x8B\x04\x04"); break;
+      case LBUr: EB(b, "\x41\x0F\xB6\x04\x04"); break;
+      default:   EB(b, "\x41\x0F\xB7\x04\x04"); break;
+      }
+      stReg(b, rd, EAX);
+      break;
+    case SBr: case SHr: case SWr:
+      memAddr(b, in);
+      ldReg(b, EDX, in->rs2);
+      if (in->Opcode == SBr) EB(b, "\x41\x88\x14\x04");
+      else if (in->Opcode == SHr) EB(b, "\x66\x41\x89\x14\x04");
+      else EB(b, "\x41\x89\x14\x04");               // mov [r12+rax], edx
+      break;
+
+    case BEQ: case BNE: case BLT: case BGE: case BLTU: case BGEU: {
+      static const uint8_t jcc[] = {
+        [BEQ - BEQ] = 0x84, [BNE - BEQ] = 0x85, [BLT - BEQ] = 0x8C,
+        [BGE - BEQ] = 0x8D, [BLTU - BEQ] = 0x82, [BGEU - BEQ] = 0x83};
+      uint32_t tgt = (pc + in->imm - IramBeginR) / InstrNrByteR;
+      if (tgt > IramNrInstrR) tgt = IramNrInstrR;
+      ldReg(b, EAX, in->rs1);
+      e1(b, 0x3B); e1(b, 0x43); e1(b, in->rs2 * 4); // cmp eax, [vs2]
+      if (tgt <= i) {
+        size_t skip = j8(b, (jcc[in->Opcode - BEQ] ^ 1) - 0x10);
+        emitJump(b, i, tgt, exitAt, fix, &nrFix, entryAt);
+        bind8(b, skip);
+      } else {
+        e1(b, 0x0F); e1(b, jcc[in->Opcode - BEQ]); e4(b, 0);
+        fix[nrFix++] = (jitFixup){b->Len - 4, tgt};
+      }
+      break;
+    }
+    case JAL: {
+      uint32_t tgt = (pc + in->imm - IramBeginR) / InstrNrByteR;
+      if (tgt > IramNrInstrR) tgt = IramNrInstrR;
+      if (rd != 0) stImm(b, rd, pc + InstrNrByteR);
+      emitJump(b, i, tgt, exitAt, fix, &nrFix, entryAt);
+      break;
+    }
+    case JALR:
+      ldReg(b, EAX, in->rs1);
+      e1(b, 0x05); e4(b, in->imm);
+      EB(b, "\x25\xFE\xFF\xFF\xFF");                // and eax, ~1
+      if (rd != 0) stImm(b, rd, pc + InstrNrByteR);
+      e1(b, 0x2D); e4(b, IramBeginR);               // sub eax, IramBeginR
+      EB(b, "\xC1\xE8\x02");                        // shr eax, 2
+      e1(b, 0x3D); e4(b, IramNrInstrR);
+      EB(b, "\xB9"); e4(b, IramNrInstrR);           // mov ecx, IramNrInstrR
+      EB(b, "\x0F\x43\xC1");                        // cmovae eax, ecx
+      EB(b, "\x41\xFF\x24\xC7");                    // jmp [r15 + rax*8]
+      break;
+
+    case CSRRSI:                                    // me()
+      if (rd == 0) break;
+      EB(b, "\x8B\x43\xF8");                        // mov eax, [rbx-8]
+      stReg(b, rd, EAX);
+      break;
+    case CSRRW:                                     // DMA
+      EB(b, "\x4C\x89\xE7");                        // mov rdi, r12
+      ldReg(b, ESI, in->rd); ldReg(b, EDX, in->rs1);
+      EB(b, "\x48\xB8"); e8(b, (uintptr_t)rvJitDma);
+      EB(b, "\xFF\xD0");                            // call rax
+      break;
+
+    case FENCE: break;
+    default: __builtin_unreachable();
+    }
+    assert(b->Len - entryAt[i] <= JitMaxInstrBytes);
+  }
+
+  for (size_t k = 0; k < nrFix; ++k) {
+    uint32_t rel = entryAt[fix[k].Target] - (fix[k].At + 4);
+    memcpy(code + fix[k].At, &rel, 4);
+  }
+  for (size_t i = 0; i <= IramNrInstrR; ++i)
+    j->Entry[i] = code + entryAt[i];
+  j->Code = code;
+  j->Enter = (rvJitEnterFn)code;
+  free(fix); free(entryAt);
+  if (mprotect(code, JitCodeBytes, PROT_READ | PROT_EXEC) != 0) {
+    perror("mprotect RvJit");
+    exit(EXIT_FAILURE);
+  }
+  return j;
+}
+
+void RvJitFree(RvJit *j) {
+  munmap(j->Code, JitCodeBytes);
+  free(j);
+}
+
+void RvDpuRunJit(RvDpu *d, size_t nrTasklets) {
+  const RvJit *j = d->Program.Jit;
+  uint32_t *csr = d->Timing.Csr;
+  RvJitCtx ctx = {0, 0, j->Entry};
+  bool running = true;
+  while (running) {
+    running = false;
+    for (size_t i = 0; i < nrTasklets; ++i) {
+      if (!((csr[0] >> i) & 1) || ((csr[NrCsr - 1] >> i) & 1)) continue;
+      running = true;
+      RvTlet *t = &d->Timing.Threads[i];
+      for (;;) {
+        ctx.NrExec = 0; ctx.Budget = JitBudget;
+        uint32_t r = j->Enter(t->Regs, d->Program.WMAram, &ctx,
+                              j->Entry[(t->Pc - IramBeginR) / InstrNrByteR]);
+        d->Timing.StatNrInstrExec += ctx.NrExec;
+        DmmMailboxPoll(&d->Mailbox, d->Program.WMAram,
+                       d->Timing.StatNrInstrExec);
+        t->Pc = IramBeginR + (r & 0xFFFF) * InstrNrByteR;
+        if (r >> 16 == JitResume) break;
+        if (r >> 16 == JitTrap) {
+          // Like the threaded code: without asserts the tasklet stops there
+          assert(0 && "DPU Trapped!");
+          fprintf(stderr, "DPU trapped at pc %#x, stopping tasklet %u\n",
+                  (unsigned)t->Pc, t->Id);
+          csr[0] &= ~(1u << i);
+          break;
+        }
+        // Pending CSR access. Keep the tasklet unless it went to sleep, got
+        // blocked, or is spinning on bits that are already set.
+        const RvInstr *in = &d->Program.Iram[r & 0xFFFF];
+        uint32_t old = csr[in->imm % NrCsr];
+        uint32_t mask = in->Opcode == CSRRS ? t->Regs[in->rs1] : in->rs1;
+        RvDpuExecuteInstr(d, t);
+        ++d->Timing.StatNrInstrExec;
+        if (!((csr[0] >> i) & 1) || ((csr[NrCsr - 1] >> i) & 1)) break;
+        if ((in->Opcode == CSRRS || in->Opcode == CSRRSI) && mask != 0 &&
+            (old & mask) == mask)
+          break;
+      }
+    }
+  }
+}
@@ -1,5 +1,6 @@
 #include "dmminternal.h"
 #include <assert.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 
@@ -15,19 +16,39 @@ void RvDpuInit(RvDpu* d, size_t memFreq, size_t logicFreq, int numaNode) {
   RvPrgInit(&d->Program, numaNode);
   RvTimingInit(&d->Timing, d->Program.Iram, memFreq, logicFreq);
   // CSR is now initialized in RvTimingInit
+  memset(&d->Mailbox, 0, sizeof(DmmMailbox));
 }
 
-void RvDpuRun(RvDpu* d, size_t nrTasklets) {
+void RvDpuStart(RvDpu* d, size_t nrTasklets) {
   for (size_t i = 0; i < nrTasklets; ++i)
     d->Timing.Threads[i].Pc = IramBeginR;
   // Clear blocked bits and set running bits for all threads
   d->Timing.Csr[0] = (1 << nrTasklets) - 1;
   d->Timing.Csr[NrCsr - 1] = 0;
+#ifdef __DMM_FUNCTIONAL_ONLY
+  DmmMailboxOpen(&d->Mailbox, d->Program.WMAram, d->Timing.StatNrInstrExec);
+#else
+  DmmMailboxOpen(&d->Mailbox, d->Program.WMAram, d->Timing.TotNrCycle);
+#endif
+}
 
-  uint32_t running = true;
-  while (running) {
+bool RvDpuStep(RvDpu* d, size_t nrTasklets, long stopAt) {
+  uint8_t *wm = d->Program.WMAram;
+#ifdef __DMM_RV_JIT
+  if (d->Program.Jit != NULL) {
+    RvDpuRunJit(d, nrTasklets);
+    DmmMailboxClose(&d->Mailbox, wm);
+    return false;
+  }
+#endif
 #ifdef __DMM_FUNCTIONAL_ONLY
-    running = false;
+  if (d->Program.Tc != NULL) {
+    RvDpuRunTc(d, nrTasklets);
+    DmmMailboxClose(&d->Mailbox, wm);
+    return false;
+  }
+  while (d->Timing.StatNrInstrExec < stopAt) {
+    bool running = false;
     for (size_t i = 0; i < nrTasklets; ++i) {
       // Check if thread is sleeping or blocked via CSR bits
       if (!((d->Timing.Csr[0] >> i) & 1)) continue;     // sleeping
@@ -36,13 +57,36 @@ void RvDpuRun(RvDpu* d, size_t nrTasklets) {
       RvDpuExecuteInstr(d, &d->Timing.Threads[i]);
       ++d->Timing.StatNrInstrExec;
     }
+    DmmMailboxPoll(&d->Mailbox, wm, d->Timing.StatNrInstrExec);
 #else
+  while (d->Timing.TotNrCycle < stopAt) {
     RvTlet *thrd = RvTimingCycle(&d->Timing, nrTasklets);
     if (thrd != NULL)
       RvDpuExecuteInstr(d, thrd);
-    running = d->Timing.Csr[0] & ((1 << nrTasklets) - 1);
+    uint32_t running = d->Timing.Csr[0] & ((1 << nrTasklets) - 1);
+    DmmMailboxPoll(&d->Mailbox, wm, d->Timing.TotNrCycle);
 #endif
+    if (!running) {
+      DmmMailboxClose(&d->Mailbox, wm);
+      return false;
+    }
   }
+  return true;
+}
+
+void RvDpuRun(RvDpu* d, size_t nrTasklets) {
+  RvDpuStart(d, nrTasklets);
+  while (RvDpuStep(d, nrTasklets, LONG_MAX))
+    ;
+}
+
+void RvDpuPrefetch(const RvDpu* d) {
+  const char *t = (const char*)&d->Timing;
+  for (size_t i = 0; i < offsetof(RvTiming, revolver) + sizeof(DmmRevolver);
+       i += 64)
+    __builtin_prefetch(t + i, 1);
+  __builtin_prefetch(d->Timing.MramTiming.ScheRob.data, 1);
+  __builtin_prefetch(d->Timing.MramTiming.ScheReadyQ.data, 1);
 }
 
 void RvDpuExecuteInstr(RvDpu* d, RvTlet* thread) {
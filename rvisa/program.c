@@ -266,33 +266,39 @@ die:
 }
 
 void RvPrgInit(RvPrg* p, int numaNode) {
-  p->WMAram = mmap(NULL, WMAINrByteR, PROT_READ | PROT_WRITE,
-                  MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
-  if (p->WMAram == MAP_FAILED) {
+  p->WMAram = DmmWmaAlloc(WMAINrByteR, numaNode);
+  p->Iram = NULL;
+  p->Tc = NULL;
+  p->Jit = NULL;
+}
+void RvPrgFini(RvPrg* p) {
+  DmmWmaFree(p->WMAram, WMAINrByteR);
+  p->WMAram = NULL;
+}
+
+RvInstr* RvIramAlloc(int numaNode) {
+  void *iram = mmap(NULL, RvIramNrByte, PROT_READ | PROT_WRITE,
+                    MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+  if (iram == MAP_FAILED) {
     perror("mmap");
     exit(EXIT_FAILURE);
   }
-  p->Iram = (RvInstr*)(p->WMAram + WramSizeR + MramSizeR);
-
-  if (madvise(p->WMAram, WMAINrByteR, MADV_HUGEPAGE) != 0)
-    perror("madvise");
   (void)numaNode;
 #ifdef __DMM_NUMA
-  // Bind WMAram to specified NUMA node
   if (numaNode >= 0) {
     struct bitmask *mask = numa_allocate_nodemask();
     numa_bitmask_setbit(mask, numaNode);
-    long ret = mbind(p->WMAram, WMAINrByteR, MPOL_BIND,
+    long ret = mbind(iram, RvIramNrByte, MPOL_BIND,
                      mask->maskp, mask->size + 1, MPOL_MF_MOVE | MPOL_MF_STRICT);
     if (ret != 0)
-      perror("mbind RvPrg WMAram");
+      perror("mbind RvPrg Iram");
     numa_free_nodemask(mask);
   }
 #endif
+  return iram;
 }
-void RvPrgFini(RvPrg* p) {
-  if (p->WMAram != NULL)
-    munmap(p->WMAram, WMAINrByteR);
+void RvIramFree(RvInstr* iram) {
+  munmap(iram, RvIramNrByte);
 }
 
 size_t RvPrgLoadBinary(RvPrg *p, const char *filename, DmmMap symbols,
@@ -322,6 +328,7 @@ size_t RvPrgLoadBinary(RvPrg *p, const char *filename, DmmMap symbols,
     goto die;
   }
   RvPrgInit(p, -1);
+  p->Iram = RvIramAlloc(-1);
 
   while ((scn = elf_nextscn(elf, scn)) != NULL) {
     GElf_Shdr shdr;
@@ -336,18 +343,16 @@ size_t RvPrgLoadBinary(RvPrg *p, const char *filename, DmmMap symbols,
       // Get symbol string table
       Elf_Scn *str_scn = elf_getscn(elf, shdr.sh_link);
       Elf_Data *str_data = elf_getdata(str_scn, NULL);
-      char *d_buf = malloc(str_data->d_size);
-      assert(d_buf != NULL);
-      memcpy(d_buf, str_data->d_buf, str_data->d_size);
       if (!str_data) continue;
-      // Process symbols
+      // Process symbols; the map copies their names out of the ELF
       size_t sym_count = shdr.sh_size / shdr.sh_entsize;
       for (size_t i = 0; i < sym_count; i++) {
         GElf_Sym sym;
         if (gelf_getsym(data, i, &sym) != &sym) continue;
-        char *name = d_buf + sym.st_name;
+        const char *name = (const char*)str_data->d_buf + sym.st_name;
         if (name[0] != '$')
-          DmmMapAssign(symbols, name, strlen(name), (uint32_t)sym.st_value);
+          DmmMapAssignCopy(symbols, name, strlen(name),
+                           (uint32_t)sym.st_value);
       }
     }
 
@@ -0,0 +1,297 @@
+#include "dmminternal.h"
+#include <assert.h>
+#include <immintrin.h>
+#include <stdlib.h>
+
+// SPMD lockstep engine for functional-only simulation. The DPUs of a set run
+// the same program on different data, so their tasklets mostly sit at the
+// same pc. Up to RvSpmdNrLane DPUs run together with every register kept as
+// a vector of one lane per DPU. A tasklet's lanes at the same pc decode the
+// instruction once; ALU ops, branches and jumps then run as vector ops on the
+// lanes, loads, stores, division and the like as a loop over them. Lanes at
+// another pc are simply the next group, so divergence only costs decoding
+// again. Whatever else (CSR, DMA, fences, traps) goes to RvDpuExecuteInstr
+// lane by lane.
+//
+// Rounds go as in the functional loop of RvDpuStep: tasklets in id order,
+// then a mailbox poll. DPUs share no state, so running tasklet i of every
+// lane before tasklet i + 1 of any keeps each DPU's own order. When a
+// tasklet's lanes diverge, only those at the lowest pc run, so that they
+// catch up with the others at the join; the rest sit the round out, at most
+// _maxWait rounds in a row so that spin loops still make progress. Like the
+// threaded code, this interleaves tasklets differently from RvDpuStep, which
+// race-free programs do not see.
+
+typedef uint32_t Lanes __attribute__((vector_size(4 * RvSpmdNrLane)));
+typedef int32_t SLanes __attribute__((vector_size(4 * RvSpmdNrLane)));
+_Static_assert(RvSpmdNrLane == 8, "Lanes should fill an AVX2 register");
+enum { _maxWait = 64 };
+
+typedef struct {
+  RvDpu *const *Dpus;
+  size_t NrTl;
+  Lanes Regs[MaxNumTasklets][NumGpRegistersR];
+  Lanes Pc[MaxNumTasklets];
+  Lanes NrExec;                 // Instructions not in StatNrInstrExec yet
+  uint32_t Run[MaxNumTasklets]; // Lanes on which the tasklet is runnable
+  uint8_t Wait[MaxNumTasklets][RvSpmdNrLane]; // Rounds sat out in a row
+} Group;
+
+static inline uint32_t _bits(Lanes v) {
+  return _mm256_movemask_ps((__m256)v);
+}
+static inline Lanes _mask(uint32_t bits) {
+  const Lanes bit = {1, 2, 4, 8, 16, 32, 64, 128};
+  return (Lanes)((bit & bits) != 0);
+}
+
+// Lane l of a tasklet to and from the RvTlet RvDpuExecuteInstr works on
+static void _scatter(Group *g, size_t tl, size_t l) {
+  RvTlet *t = &g->Dpus[l]->Timing.Threads[tl];
+  for (size_t r = 0; r < NumGpRegistersR; ++r)
+    t->Regs[r] = g->Regs[tl][r][l];
+  t->Pc = g->Pc[tl][l];
+}
+static void _gather(Group *g, size_t tl, size_t l) {
+  RvTlet *t = &g->Dpus[l]->Timing.Threads[tl];
+  for (size_t r = 0; r < NumGpRegistersR; ++r)
+    g->Regs[tl][r][l] = t->Regs[r];
+  g->Pc[tl][l] = t->Pc;
+}
+static void _flush(Group *g, size_t l) {
+  g->Dpus[l]->Timing.StatNrInstrExec += g->NrExec[l];
+  g->NrExec[l] = 0;
+}
+// Only CSR writes wake, put to sleep or block tasklets
+static void _refresh(Group *g, size_t l) {
+  const uint32_t *csr = g->Dpus[l]->Timing.Csr;
+  uint32_t on = csr[0] & ~csr[31];
+  for (size_t tl = 0; tl < g->NrTl; ++tl)
+    g->Run[tl] = (g->Run[tl] & ~(1u << l)) | (on >> tl & 1) << l;
+}
+
+static inline uint32_t _addr(uint32_t vs1, int32_t imm) {
+  uint32_t a = vs1 + imm;
+  return a >= WramSizeR ? a - (MramBeginR - WramSizeR) : a;
+}
+
+// Loads, stores and ops with no cheap vector form, lane by lane; false if
+// instr is none of them
+static bool _lanes(Group *g, size_t tl, uint32_t lanes, const RvInstr *in) {
+  switch (in->Opcode) {
+  case MULH: case MULHSU: case MULHU: case DIV: case DIVU: case REM:
+  case REMU: case CLZr: case CTZ: case CPOP:
+  case LBr: case LHr: case LWr: case LBUr: case LHUr: case SBr: case SHr:
+  case SWr: break;
+  default: return false;
+  }
+  Lanes *r = g->Regs[tl];
+  for (uint32_t b = lanes; b; b &= b - 1) {
+    size_t l = __builtin_ctz(b);
+    uint8_t *wm = g->Dpus[l]->Program.WMAram;
+    uint32_t vs1 = r[in->rs1][l], vs2 = r[in->rs2][l], res;
+    uint32_t a = _addr(vs1, in->imm);
+    switch (in->Opcode) {
+    case MULH: res = (int64_t)(int32_t)vs1 * (int64_t)(int32_t)vs2 >> 32; break;
+    case MULHSU: res = ((int64_t)(int32_t)vs1 * (uint64_t)vs2) >> 32; break;
+    case MULHU: res = (uint64_t)vs1 * (uint64_t)vs2 >> 32; break;
+    case DIV:
+      if (vs2 == 0) res = -1;
+      else if (vs1 == 0x80000000 && vs2 == 0xFFFFFFFF) res = 0x80000000;
+      else res = (int32_t)vs1 / (int32_t)vs2;
+      break;
+    case DIVU: res = vs2 == 0 ? 0xFFFFFFFF : vs1 / vs2; break;
+    case REM:
+      if (vs2 == 0) res = vs1;
+      else if (vs1 == 0x80000000 && vs2 == 0xFFFFFFFF) res = 0;
+      else res = (int32_t)vs1 % (int32_t)vs2;
+      break;
+    case REMU: res = vs2 == 0 ? vs1 : vs1 % vs2; break;
+    case CLZr: res = vs1 ? __builtin_clz(vs1) : 32; break;
+    case CTZ: res = vs1 ? __builtin_ctz(vs1) : 32; break;
+    case CPOP: res = __builtin_popcount(vs1); break;
+    case LBr: res = (int32_t)(int8_t)wm[a]; break;
+    case LHr: res = (int32_t)(int16_t)*(uint16_t*)(wm + a); break;
+    case LWr: res = *(uint32_t*)(wm + a); break;
+    case LBUr: res = wm[a]; break;
+    case LHUr: res = *(uint16_t*)(wm + a); break;
+    case SBr: wm[a] = vs2; continue;
+    case SHr: *(uint16_t*)(wm + a) = vs2; continue;
+    case SWr: *(uint32_t*)(wm + a) = vs2; continue;
+    default: __builtin_unreachable();
+    }
+    if (in->rd != 0)
+      r[in->rd][l] = res;
+  }
+  return true;
+}
+
+// ALU ops, branches and jumps as vector ops on the lanes in mask m; false if
+// instr is none of them
+static bool _vector(Group *g, size_t tl, Lanes m, const RvInstr *in) {
+  Lanes *r = g->Regs[tl];
+  Lanes a = r[in->rs1], b = r[in->rs2], pc = g->Pc[tl], res;
+  SLanes sa = (SLanes)a, sb = (SLanes)b;
+  uint32_t imm = in->imm;
+  Lanes next = pc + InstrNrByteR, taken;
+  switch (in->Opcode) {
+  case ADDr: res = a + b; break;
+  case SUBr: res = a - b; break;
+  case ANDr: res = a & b; break;
+  case ORr:  res = a | b; break;
+  case XORr: res = a ^ b; break;
+  case SLL: res = a << (b & 31); break;
+  case SRL: res = a >> (b & 31); break;
+  case SRA: res = (Lanes)(sa >> (SLanes)(b & 31)); break;
+  case SLT: res = (Lanes)(sa < sb) & 1; break;
+  case SLTU: res = (Lanes)(a < b) & 1; break;
+  case MUL: res = a * b; break;
+  case MIN: taken = (Lanes)(sa < sb); goto pick;
+  case MAXr: taken = (Lanes)(sa > sb); goto pick;
+  case MINU: taken = (Lanes)(a < b); goto pick;
+  case MAXU: taken = (Lanes)(a > b); goto pick;
+  pick:
+    res = (a & taken) | (b & ~taken);
+    break;
+  case SEXT_B: res = (Lanes)(((SLanes)(a << 24)) >> 24); break;
+  case SEXT_H: res = (Lanes)(((SLanes)(a << 16)) >> 16); break;
+  case ZEXT_H: res = a & 0xffff; break;
+  case ANDNr: res = a & ~b; break;
+  case ORNr: res = a | ~b; break;
+  case XNOR: res = ~(a ^ b); break;
+  case ROLr: res = a << (b & 31) | a >> ((32 - (b & 31)) & 31); break;
+  case RORr: res = a >> (b & 31) | a << ((32 - (b & 31)) & 31); break;
+  case RORI: res = a >> (imm & 31) | a << ((32 - (imm & 31)) & 31); break;
+  case ADDI: res = a + imm; break;
+  case ANDI: res = a & imm; break;
+  case ORI:  res = a | imm; break;
+  case XORI: res = a ^ imm; break;
+  case SLLI: res = a << (imm & 31); break;
+  case SRLI: res = a >> (imm & 31); break;
+  case SRAI: res = (Lanes)(sa >> (int32_t)(imm & 31)); break;
+  case SLTI: res = (Lanes)(sa < (int32_t)imm) & 1; break;
+  case SLTIU: res = (Lanes)(a < imm) & 1; break;
+  case LUI: res = (Lanes){0} + imm; break;
+  case AUIPC: res = pc + imm; break;
+
+  case BEQ: taken = (Lanes)(a == b); goto branch;
+  case BNE: taken = (Lanes)(a != b); goto branch;
+  case BLT: taken = (Lanes)(sa < sb); goto branch;
+  case BGE: taken = (Lanes)(sa >= sb); goto branch;
+  case BLTU: taken = (Lanes)(a < b); goto branch;
+  case BGEU: taken = (Lanes)(a >= b); goto branch;
+  branch:
+    next = ((pc + imm) & taken) | (next & ~taken);
+    g->Pc[tl] = (next & m) | (g->Pc[tl] & ~m);
+    return true;
+  case JAL:
+    res = next;
+    next = pc + imm;
+    break;
+  case JALR:
+    res = next;
+    next = (a + imm) & ~1u;
+    break;
+  default: return false;
+  }
+  if (in->rd != 0)
+    r[in->rd] = (res & m) | (r[in->rd] & ~m);
+  g->Pc[tl] = (next & m) | (g->Pc[tl] & ~m);
+  return true;
+}
+
+// Tasklet tl of the lanes in same, all at pc, executes one instruction
+static void _exec(Group *g, size_t tl, uint32_t same, uint32_t pc) {
+  Lanes m = _mask(same);
+  const RvInstr *in = &g->Dpus[__builtin_ctz(same)]
+                           ->Program.Iram[(pc - IramBeginR) / InstrNrByteR];
+  if (_vector(g, tl, m, in))
+    return;
+  if (_lanes(g, tl, same, in)) {
+    g->Pc[tl] = ((g->Pc[tl] + InstrNrByteR) & m) | (g->Pc[tl] & ~m);
+    return;
+  }
+  for (uint32_t b = same; b; b &= b - 1) {
+    size_t l = __builtin_ctz(b);
+    _flush(g, l);
+    _scatter(g, tl, l);
+    RvDpuExecuteInstr(g->Dpus[l], &g->Dpus[l]->Timing.Threads[tl]);
+    _gather(g, tl, l);
+    _refresh(g, l);
+  }
+}
+
+// Tasklet tl of the lanes in run executes one instruction each, see the top.
+// Returns the lanes that did.
+static uint32_t _step(Group *g, size_t tl, uint32_t run) {
+  uint32_t pc = g->Pc[tl][__builtin_ctz(run)];
+  uint32_t same = _bits((Lanes)(g->Pc[tl] == pc)) & run;
+  if (same == run) {
+    _exec(g, tl, run, pc);
+    return run;
+  }
+  for (uint32_t b = run; b; b &= b - 1)
+    if (g->Pc[tl][__builtin_ctz(b)] < pc)
+      pc = g->Pc[tl][__builtin_ctz(b)];
+  uint32_t done = 0;
+  for (bool lowest = true; run; lowest = false) {
+    same = _bits((Lanes)(g->Pc[tl] == pc)) & run;
+    run &= ~same;
+    uint32_t go = same;
+    for (uint32_t b = same; b; b &= b - 1) {
+      size_t l = __builtin_ctz(b);
+      if (lowest || g->Wait[tl][l] >= _maxWait) {
+        g->Wait[tl][l] = 0;
+      } else {
+        ++g->Wait[tl][l];
+        go &= ~(1u << l);
+      }
+    }
+    if (go != 0)
+      _exec(g, tl, go, pc);
+    done |= go;
+    if (run != 0)
+      pc = g->Pc[tl][__builtin_ctz(run)];
+  }
+  return done;
+}
+
+void RvDpuRunSpmd(RvDpu *const *dpus, size_t nrDpu, size_t nrTasklets) {
+  assert(nrDpu <= RvSpmdNrLane);
+  Group *g = aligned_alloc(_Alignof(Group), sizeof(Group));
+  memset(g, 0, sizeof(Group));
+  g->Dpus = dpus;
+  g->NrTl = nrTasklets;
+  uint32_t live = 0;
+  for (size_t l = 0; l < nrDpu; ++l) {
+    RvDpuStart(dpus[l], nrTasklets);
+    for (size_t tl = 0; tl < MaxNumTasklets; ++tl)
+      _gather(g, tl, l);
+    _refresh(g, l);
+    live |= 1u << l;
+  }
+  while (live) {
+    uint32_t ran = 0;
+    for (size_t tl = 0; tl < nrTasklets; ++tl) {
+      uint32_t run = g->Run[tl] & live;
+      if (run == 0)
+        continue;
+      ran |= run;
+      g->NrExec += _mask(_step(g, tl, run)) & 1;
+    }
+    for (uint32_t b = live; b; b &= b - 1) {
+      size_t l = __builtin_ctz(b);
+      RvDpu *d = dpus[l];
+      _flush(g, l);
+      DmmMailboxPoll(&d->Mailbox, d->Program.WMAram, d->Timing.StatNrInstrExec);
+      if (ran >> l & 1)
+        continue;
+      DmmMailboxClose(&d->Mailbox, d->Program.WMAram);
+      live &= ~(1u << l);
+    }
+  }
+  for (size_t l = 0; l < nrDpu; ++l)
+    for (size_t tl = 0; tl < MaxNumTasklets; ++tl)
+      _scatter(g, tl, l);
+  free(g);
+}
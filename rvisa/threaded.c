@@ -0,0 +1,522 @@
+#include "dmminternal.h"
+#include <assert.h>
+#include <limits.h>
+#include <linux/futex.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// Threaded-code engine for functional-only simulation. At dpu_load the decoded
+// IRAM is turned into a stream of RvTcInstr whose `Handler` points straight at
+// the label implementing it, so executing an instruction is a single indirect
+// jump. Per-instruction work done by RvDpuExecuteInstr at runtime (pc to IRAM
+// index, auipc/jal pc arithmetic, x0 writes, CSR number decoding) is resolved
+// here once.
+//
+// A tasklet keeps the host thread until it executes a control transfer or a
+// CSR access, so dispatch between tasklets happens once per basic block rather
+// than once per instruction. Frequent instruction pairs are fused into
+// superinstructions; the second slot keeps its own handler so a jump into it
+// still works.
+//
+// RvDpuRunPar splits the tasklets of one DPU among host threads, each running
+// this engine on its own subset against the shared WMAram. CSR accesses are
+// host atomics; a thread with none of its tasklets awake parks on a futex on
+// CSR 0 (the run bits) until some other thread's CSR access wakes one.
+
+// Handlers not tied 1:1 to an RvOpcode. Indices follow RvNrOpcode in `hTbl`.
+enum {
+  TcNop = RvNrOpcode,
+  TcLi,      // lui / auipc: rd = precomputed constant
+  TcJ,       // jal x0
+  TcJr,      // jalr x0
+  TcDma,     // csrrw to 0x803
+  TcMe,      // csrrsi 0xf14: tasklet id
+  TcTrap,    // ecall / ebreak / pc out of IRAM
+  // Superinstructions, named after the pair they replace
+  TcLiAddi,  // lui/auipc + addi on the same register: one constant
+  TcAddiBeq, TcAddiBne, TcAddiBlt, TcAddiBge, TcAddiBltu, TcAddiBgeu,
+  TcSlliAdd, TcAddLw, TcAddSw, TcAddiLw, TcAddiSw,
+  TcNrHandler
+};
+
+// Host threads running one DPU together
+typedef struct {
+  uint32_t All;        // Tasklets of the DPU
+  uint32_t NrPark;     // Threads waiting in tcPark
+} RvTcShare;
+enum { TcNrSpin = 1 << 10, TcLeadParkNsec = 100000 };
+
+static inline uint32_t tcRun(const uint32_t *csr, uint32_t mine) {
+  return __atomic_load_n(&csr[0], __ATOMIC_ACQUIRE) &
+         ~__atomic_load_n(&csr[NrCsr - 1], __ATOMIC_RELAXED) & mine;
+}
+// Wait for CSR 0 to change; false once no tasklet of the DPU is awake. The
+// lead thread, which polls the mailbox, does not sleep for long.
+static bool tcPark(uint32_t *csr, uint32_t mine, RvTcShare *sh) {
+  uint32_t c = __atomic_load_n(&csr[0], __ATOMIC_SEQ_CST);
+  if ((c & sh->All) == 0) return false;
+  if (c & mine) return true;
+  for (int i = 0; i < TcNrSpin; ++i) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+    if (__atomic_load_n(&csr[0], __ATOMIC_RELAXED) != c) return true;
+  }
+  struct timespec ts = {0, TcLeadParkNsec};
+  __atomic_fetch_add(&sh->NrPark, 1, __ATOMIC_SEQ_CST);
+  syscall(SYS_futex, &csr[0], FUTEX_WAIT_PRIVATE, c, (mine & 1) ? &ts : NULL,
+          NULL, 0);
+  __atomic_fetch_sub(&sh->NrPark, 1, __ATOMIC_RELAXED);
+  return true;
+}
+// What CSR accesses do when no other thread runs tasklets of the DPU
+static inline uint32_t tcPlain_exchange_n(uint32_t *c, uint32_t v) {
+  uint32_t o = *c; *c = v; return o;
+}
+static inline uint32_t tcPlain_fetch_or(uint32_t *c, uint32_t v) {
+  uint32_t o = *c; *c |= v; return o;
+}
+static inline uint32_t tcPlain_fetch_and(uint32_t *c, uint32_t v) {
+  uint32_t o = *c; *c &= v; return o;
+}
+static inline void tcWake(uint32_t *csr, RvTcShare *sh) {
+  if (__atomic_load_n(&sh->NrPark, __ATOMIC_SEQ_CST) != 0)
+    syscall(SYS_futex, &csr[0], FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+}
+
+// Runs the tasklets in mine; sh is NULL when they are all of the DPU's
+static bool rvTc(RvDpu *d, uint32_t mine, RvTcShare *sh, RvTcInstr *out,
+                 const RvInstr *iram) {
+  static const void *const hTbl[TcNrHandler] = {
+    [ADDr] = &&ADDr, [SUBr] = &&SUBr, [ANDr] = &&ANDr, [ORr] = &&ORr,
+    [XORr] = &&XORr, [SLL] = &&SLL, [SRL] = &&SRL, [SRA] = &&SRA,
+    [SLT] = &&SLT, [SLTU] = &&SLTU,
+    [MUL] = &&MUL, [MULH] = &&MULH, [MULHSU] = &&MULHSU, [MULHU] = &&MULHU,
+    [DIV] = &&DIV, [DIVU] = &&DIVU, [REM] = &&REM, [REMU] = &&REMU,
+    [MIN] = &&MIN, [MAXr] = &&MAXr, [MINU] = &&MINU, [MAXU] = &&MAXU,
+    [CLZr] = &&CLZr, [CTZ] = &&CTZ, [CPOP] = &&CPOP,
+    [SEXT_B] = &&SEXT_B, [SEXT_H] = &&SEXT_H, [ZEXT_H] = &&ZEXT_H,
+    [ANDNr] = &&ANDNr, [ORNr] = &&ORNr, [XNOR] = &&XNOR,
+    [ROLr] = &&ROLr, [RORr] = &&RORr, [RORI] = &&RORI,
+    [REV8] = &&TRAP, [ORC_B] = &&TRAP,
+    [ADDI] = &&ADDI, [ANDI] = &&ANDI, [ORI] = &&ORI, [XORI] = &&XORI,
+    [SLLI] = &&SLLI, [SRLI] = &&SRLI, [SRAI] = &&SRAI,
+    [SLTI] = &&SLTI, [SLTIU] = &&SLTIU,
+    [LBr] = &&LBr, [LHr] = &&LHr, [LWr] = &&LWr, [LBUr] = &&LBUr,
+    [LHUr] = &&LHUr, [SBr] = &&SBr, [SHr] = &&SHr, [SWr] = &&SWr,
+    [BEQ] = &&BEQ, [BNE] = &&BNE, [BLT] = &&BLT, [BGE] = &&BGE,
+    [BLTU] = &&BLTU, [BGEU] = &&BGEU, [JAL] = &&JAL, [JALR] = &&JALR,
+    [CSRRW] = &&CSRRW, [CSRRS] = &&CSRRS, [CSRRC] = &&CSRRC,
+    [CSRRWI] = &&CSRRWI, [CSRRSI] = &&CSRRSI, [CSRRCI] = &&CSRRCI,
+    [FENCE] = &&NOP, [ECALL] = &&TRAP, [EBREAK] = &&TRAP,
+    [TcNop] = &&NOP, [TcLi] = &&LI, [TcJ] = &&J, [TcJr] = &&JR,
+    [TcDma] = &&DMA, [TcMe] = &&ME, [TcTrap] = &&TRAP, [TcLiAddi] = &&LI_ADDI,
+    [TcAddiBeq] = &&ADDI_BEQ, [TcAddiBne] = &&ADDI_BNE,
+    [TcAddiBlt] = &&ADDI_BLT, [TcAddiBge] = &&ADDI_BGE,
+    [TcAddiBltu] = &&ADDI_BLTU, [TcAddiBgeu] = &&ADDI_BGEU,
+    [TcSlliAdd] = &&SLLI_ADD, [TcAddLw] = &&ADD_LW, [TcAddSw] = &&ADD_SW,
+    [TcAddiLw] = &&ADDI_LW, [TcAddiSw] = &&ADDI_SW,
+  };
+  // {first, second, fused}; matched against the unfused handlers
+  static const uint8_t fuseTbl[][3] = {
+    {ADDI, BEQ, TcAddiBeq}, {ADDI, BNE, TcAddiBne}, {ADDI, BLT, TcAddiBlt},
+    {ADDI, BGE, TcAddiBge}, {ADDI, BLTU, TcAddiBltu},
+    {ADDI, BGEU, TcAddiBgeu}, {SLLI, ADDr, TcSlliAdd},
+    {ADDr, LWr, TcAddLw}, {ADDr, SWr, TcAddSw},
+    {ADDI, LWr, TcAddiLw}, {ADDI, SWr, TcAddiSw},
+  };
+
+  // Translation mode
+  if (out != NULL) {
+    for (size_t i = 0; i < IramNrInstrR; ++i) {
+      RvInstr in = iram[i];
+      uint32_t pc = IramBeginR + i * InstrNrByteR;
+      size_t h = in.Opcode;
+      RvTcInstr *o = &out[i];
+      o->rd = in.rd; o->rs1 = in.rs1; o->rs2 = in.rs2; o->imm = in.imm;
+      switch (in.Opcode) {
+      case LUI: h = TcLi; break;
+      case AUIPC: h = TcLi; o->imm = pc + in.imm; break;
+      case BEQ: case BNE: case BLT: case BGE: case BLTU: case BGEU:
+      case JAL: {
+        // Branch targets become stream indices; stray ones trap
+        uint32_t tgt = (pc + in.imm - IramBeginR) / InstrNrByteR;
+        o->imm = tgt < IramNrInstrR ? tgt : IramNrInstrR;
+        if (in.Opcode == JAL && in.rd == 0) h = TcJ;
+        break;
+      }
+      case JALR: if (in.rd == 0) h = TcJr; break;
+      case CSRRW: case CSRRS: case CSRRC:
+      case CSRRWI: case CSRRSI: case CSRRCI:
+        o->imm = in.imm % NrCsr;
+        if (in.Opcode == CSRRW && o->imm == 3) h = TcDma;
+        if (in.Opcode == CSRRSI && o->imm == 20 && in.rd != 0) h = TcMe;
+        break;
+      default: break;
+      }
+      // Everything before stores only writes rd; with x0 these are no-ops
+      if (in.rd == 0 && in.Opcode < SBr) h = TcNop;
+      o->Handler = hTbl[h];
+    }
+    out[IramNrInstrR] = (RvTcInstr){.Handler = hTbl[TcTrap]};
+
+    for (size_t i = 0; i + 1 < IramNrInstrR; ++i) {
+      RvTcInstr *o = &out[i];
+      const RvInstr *nx = &iram[i + 1];
+      if (o->Handler == hTbl[TcLi] && nx->Opcode == ADDI &&
+          nx->rd == o->rd && nx->rs1 == o->rd) {
+        o->imm += nx->imm;
+        o->Handler = hTbl[TcLiAddi];
+        continue;
+      }
+      for (size_t j = 0; j < sizeof(fuseTbl) / sizeof(fuseTbl[0]); ++j)
+        if (o->Handler == hTbl[fuseTbl[j][0]] &&
+            out[i + 1].Handler == hTbl[fuseTbl[j][1]]) {
+          o->Handler = hTbl[fuseTbl[j][2]];
+          break;
+        }
+    }
+    return true;
+  }
+
+  // Execution mode. Tasklets are visited round-robin in increasing id order,
+  // like the switch-based functional loop in RvDpuRun, but each turn runs a
+  // basic block instead of a single instruction.
+  const RvTcInstr *code = d->Program.Tc, *ip;
+  const RvTcInstr *ips[MaxNumTasklets];
+  RvTlet *thrds = d->Timing.Threads;
+  uint32_t *csr = d->Timing.Csr, *R;
+  uint8_t *wm = d->Program.WMAram;
+  uint32_t run = tcRun(csr, mine);
+  long nrExec = 0;
+  size_t cur;
+  for (uint32_t m = mine; m; m &= m - 1) {
+    size_t i = __builtin_ctz(m);
+    ips[i] = &code[(thrds[i].Pc - IramBeginR) / InstrNrByteR];
+  }
+  if (run == 0 && (sh == NULL || !tcPark(csr, mine, sh))) return false;
+  if (run == 0) goto roundEnd;
+  cur = __builtin_ctz(run);
+  ip = ips[cur]; R = thrds[cur].Regs;
+  goto *ip->Handler;
+
+  // Pick the next runnable tasklet after `cur`, starting a new round when none
+  // is left. The simulation ends when a new round finds no runnable tasklet;
+  // with other threads it ends once none of the DPU's is awake.
+#define DISPATCH() do {                                                        \
+    ++nrExec; ips[cur] = ip;                                                   \
+    uint32_t m_ = run & (~1u << cur);                                          \
+    if (__builtin_expect(m_ == 0, 0)) goto roundEnd;                           \
+    cur = __builtin_ctz(m_);                                                   \
+    ip = ips[cur]; R = thrds[cur].Regs;                                        \
+    goto *ip->Handler;                                                         \
+  } while (0)
+#define NEXT() do { ++nrExec; ++ip; goto *ip->Handler; } while (0)
+#define BRANCH(cond) do {                                                      \
+    ip = (cond) ? &code[ip->imm] : ip + 1; DISPATCH(); } while (0)
+#define RD  R[ip->rd]
+#define VS1 R[ip->rs1]
+#define VS2 R[ip->rs2]
+#define IMM ip->imm
+  // WRAM is mapped at [0, 64K); MRAM at MramBeginR is placed right after it
+#define MADDR(a) ((a) - ((a) >= WramSizeR ? MramBeginR - WramSizeR : 0))
+#define CSRWB(v) do { if (ip->rd != 0) RD = (v); } while (0)
+
+roundEnd:
+  if (mine & 1)
+    DmmMailboxPoll(&d->Mailbox, wm,
+                   __atomic_load_n(&d->Timing.StatNrInstrExec, __ATOMIC_RELAXED) +
+                       nrExec);
+  if (sh != NULL && (run = tcRun(csr, mine)) == 0 && tcPark(csr, mine, sh))
+    goto roundEnd;
+  if (run == 0) goto done;
+  cur = __builtin_ctz(run);
+  ip = ips[cur]; R = thrds[cur].Regs;
+  goto *ip->Handler;
+
+ADDr: RD = VS1 + VS2; NEXT();
+SUBr: RD = VS1 - VS2; NEXT();
+ANDr: RD = VS1 & VS2; NEXT();
+ORr:  RD = VS1 | VS2; NEXT();
+XORr: RD = VS1 ^ VS2; NEXT();
+SLL:  RD = VS1 << (VS2 & 0x1F); NEXT();
+SRL:  RD = VS1 >> (VS2 & 0x1F); NEXT();
+SRA:  RD = (int32_t)VS1 >> (VS2 & 0x1F); NEXT();
+SLT:  RD = (int32_t)VS1 < (int32_t)VS2; NEXT();
+SLTU: RD = VS1 < VS2; NEXT();
+
+MUL: RD = VS1 * VS2; NEXT();
+MULH: RD = (int64_t)(int32_t)VS1 * (int64_t)(int32_t)VS2 >> 32; NEXT();
+MULHSU: RD = ((int64_t)(int32_t)VS1 * (uint64_t)VS2) >> 32; NEXT();
+MULHU: RD = (uint64_t)VS1 * (uint64_t)VS2 >> 32; NEXT();
+DIV: {
+  uint32_t a = VS1, b = VS2;
+  if (b == 0) RD = -1;
+  else if (a == 0x80000000 && b == 0xFFFFFFFF) RD = 0x80000000;
+  else RD = (int32_t)a / (int32_t)b;
+  NEXT();
+}
+DIVU: { uint32_t a = VS1, b = VS2; RD = b == 0 ? 0xFFFFFFFF : a / b; NEXT(); }
+REM: {
+  uint32_t a = VS1, b = VS2;
+  if (b == 0) RD = a;
+  else if (a == 0x80000000 && b == 0xFFFFFFFF) RD = 0;
+  else RD = (int32_t)a % (int32_t)b;
+  NEXT();
+}
+REMU: { uint32_t a = VS1, b = VS2; RD = b == 0 ? a : a % b; NEXT(); }
+
+MIN: { uint32_t a = VS1, b = VS2; RD = (int32_t)a < (int32_t)b ? a : b; NEXT(); }
+MAXr: { uint32_t a = VS1, b = VS2; RD = (int32_t)a > (int32_t)b ? a : b; NEXT(); }
+MINU: { uint32_t a = VS1, b = VS2; RD = a < b ? a : b; NEXT(); }
+MAXU: { uint32_t a = VS1, b = VS2; RD = a > b ? a : b; NEXT(); }
+CLZr: { uint32_t a = VS1; RD = a ? __builtin_clz(a) : 32; NEXT(); }
+CTZ: { uint32_t a = VS1; RD = a ? __builtin_ctz(a) : 32; NEXT(); }
+CPOP: RD = __builtin_popcount(VS1); NEXT();
+SEXT_B: RD = (int32_t)(int8_t)VS1; NEXT();
+SEXT_H: RD = (int32_t)(int16_t)VS1; NEXT();
+ZEXT_H: RD = VS1 & 0xFFFF; NEXT();
+ANDNr: RD = VS1 & ~VS2; NEXT();
+ORNr: RD = VS1 | ~VS2; NEXT();
+XNOR: RD = ~(VS1 ^ VS2); NEXT();
+ROLr: RD = __builtin_rotateleft32(VS1, VS2 & 31); NEXT();
+RORr: RD = __builtin_rotateright32(VS1, VS2 & 31); NEXT();
+RORI: RD = __builtin_rotateright32(VS1, IMM & 31); NEXT();
+
+ADDI: RD = VS1 + IMM; NEXT();
+ANDI: RD = VS1 & IMM; NEXT();
+ORI:  RD = VS1 | IMM; NEXT();
+XORI: RD = VS1 ^ IMM; NEXT();
+SLLI: RD = VS1 << (IMM & 0x1F); NEXT();
+SRLI: RD = VS1 >> (IMM & 0x1F); NEXT();
+SRAI: RD = (int32_t)VS1 >> (IMM & 0x1F); NEXT();
+SLTI: RD = (int32_t)VS1 < (int32_t)IMM; NEXT();
+SLTIU: RD = VS1 < (uint32_t)IMM; NEXT();
+LI: RD = IMM; NEXT();
+
+LBr: { uint32_t a = VS1 + IMM; RD = (int32_t)(int8_t)wm[MADDR(a)]; NEXT(); }
+LHr: {
+  uint32_t a = VS1 + IMM;
+  RD = (int32_t)(int16_t)*(uint16_t *)(wm + MADDR(a)); NEXT();
+}
+LWr: { uint32_t a = VS1 + IMM; RD = *(uint32_t *)(wm + MADDR(a)); NEXT(); }
+LBUr: { uint32_t a = VS1 + IMM; RD = wm[MADDR(a)]; NEXT(); }
+LHUr: { uint32_t a = VS1 + IMM; RD = *(uint16_t *)(wm + MADDR(a)); NEXT(); }
+SBr: { uint32_t a = VS1 + IMM; wm[MADDR(a)] = VS2; NEXT(); }
+SHr: { uint32_t a = VS1 + IMM; *(uint16_t *)(wm + MADDR(a)) = VS2; NEXT(); }
+SWr: { uint32_t a = VS1 + IMM; *(uint32_t *)(wm + MADDR(a)) = VS2; NEXT(); }
+
+BEQ: BRANCH(VS1 == VS2);
+BNE: BRANCH(VS1 != VS2);
+BLT: BRANCH((int32_t)VS1 < (int32_t)VS2);
+BGE: BRANCH((int32_t)VS1 >= (int32_t)VS2);
+BLTU: BRANCH(VS1 < VS2);
+BGEU: BRANCH(VS1 >= VS2);
+J: ip = &code[IMM]; DISPATCH();
+JAL:
+  RD = IramBeginR + (ip - code + 1) * InstrNrByteR;
+  ip = &code[IMM]; DISPATCH();
+JR: JALR: {
+  uint32_t tgt = ((VS1 + IMM) & ~1u) - IramBeginR;
+  if (ip->rd != 0) RD = IramBeginR + (ip - code + 1) * InstrNrByteR;
+  tgt /= InstrNrByteR;
+  ip = &code[tgt < IramNrInstrR ? tgt : IramNrInstrR]; DISPATCH();
+}
+
+  // CSR instructions may put tasklets to sleep or wake them up. They are
+  // atomic when other threads run tasklets of the same DPU.
+#define CSRAT(op, v) (sh != NULL                                               \
+    ? __atomic_##op(&csr[IMM], (v), __ATOMIC_SEQ_CST)                          \
+    : tcPlain_##op(&csr[IMM], (v)))
+CSRRW: { uint32_t v = VS1, o = CSRAT(exchange_n, v); CSRWB(o); goto csrDone; }
+CSRRS: { uint32_t v = VS1, o = CSRAT(fetch_or, v); CSRWB(o); goto csrDone; }
+CSRRC: { uint32_t v = VS1, o = CSRAT(fetch_and, ~v); CSRWB(o); goto csrDone; }
+CSRRWI: { uint32_t o = CSRAT(exchange_n, ip->rs1); CSRWB(o); goto csrDone; }
+CSRRCI: { uint32_t o = CSRAT(fetch_and, ~(uint32_t)ip->rs1); CSRWB(o); goto csrDone; }
+CSRRSI: {
+  uint32_t o = CSRAT(fetch_or, ip->rs1);
+  if (IMM == 0) o = d->Timing.StatNrCycle;
+  if (IMM == 2)
+    o = __atomic_load_n(&d->Timing.StatNrInstrExec, __ATOMIC_RELAXED) + nrExec;
+  CSRWB(o); goto csrDone;
+}
+csrDone:
+  if (sh != NULL && IMM == 0) tcWake(csr, sh);
+  run = tcRun(csr, mine);
+  ++ip; DISPATCH();
+ME:
+  RD = thrds[cur].Id;
+  if (ip->rs1 != 0) CSRAT(fetch_or, ip->rs1);
+  NEXT();
+#undef CSRAT
+DMA: {
+  uint32_t v = VS1;
+  uint8_t *wramAddr = wm + (v >> 16);
+  uint8_t *mramAddr = wm + WramSizeR + ((RD - MramBeginR) & MramMaskR);
+  memcpy((v & 32768) ? mramAddr : wramAddr, (v & 32768) ? wramAddr : mramAddr,
+         v & 32767);
+  ++ip; DISPATCH();
+}
+
+  // The first half runs here, then control falls into the second's handler
+#define FUSED(first, second) do { first; ++nrExec; ++ip; goto second; } while (0)
+LI_ADDI: RD = IMM; ++nrExec; ++ip; NEXT(); // imm already includes the addi
+ADDI_BEQ: FUSED(RD = VS1 + IMM, BEQ);
+ADDI_BNE: FUSED(RD = VS1 + IMM, BNE);
+ADDI_BLT: FUSED(RD = VS1 + IMM, BLT);
+ADDI_BGE: FUSED(RD = VS1 + IMM, BGE);
+ADDI_BLTU: FUSED(RD = VS1 + IMM, BLTU);
+ADDI_BGEU: FUSED(RD = VS1 + IMM, BGEU);
+SLLI_ADD: FUSED(RD = VS1 << (IMM & 0x1F), ADDr);
+ADD_LW: FUSED(RD = VS1 + VS2, LWr);
+ADD_SW: FUSED(RD = VS1 + VS2, SWr);
+ADDI_LW: FUSED(RD = VS1 + IMM, LWr);
+ADDI_SW: FUSED(RD = VS1 + IMM, SWr);
+#undef FUSED
+
+  // Like RvDpuExecuteInstr; without asserts the tasklet stops where it trapped
+TRAP:
+  assert(0 && "DPU Trapped!");
+  fprintf(stderr, "DPU trapped at pc %#x, stopping tasklet %u\n",
+          (unsigned)(IramBeginR + (ip - code) * InstrNrByteR), thrds[cur].Id);
+  if (sh != NULL) {
+    __atomic_fetch_and(&csr[0], ~(1u << cur), __ATOMIC_SEQ_CST);
+    tcWake(csr, sh);
+  } else
+    csr[0] &= ~(1u << cur);
+  run = tcRun(csr, mine);
+  DISPATCH();
+NOP: NEXT();
+
+done:
+  for (uint32_t m = mine; m; m &= m - 1) {
+    size_t i = __builtin_ctz(m);
+    thrds[i].Pc = IramBeginR + (ips[i] - code) * InstrNrByteR;
+  }
+  __atomic_fetch_add(&d->Timing.StatNrInstrExec, nrExec, __ATOMIC_RELAXED);
+  return true;
+#undef DISPATCH
+#undef NEXT
+#undef BRANCH
+#undef RD
+#undef VS1
+#undef VS2
+#undef IMM
+#undef MADDR
+#undef CSRWB
+}
+
+RvTcInstr *RvTcBuild(const RvInstr *iram) {
+  RvTcInstr *tc = malloc((IramNrInstrR + 1) * sizeof(RvTcInstr));
+  if (tc == NULL) {
+    perror("malloc RvTcInstr");
+    exit(EXIT_FAILURE);
+  }
+  rvTc(NULL, 0, NULL, tc, iram);
+  return tc;
+}
+
+void RvDpuRunTc(RvDpu *d, size_t nrTasklets) {
+  rvTc(d, (1u << nrTasklets) - 1, NULL, NULL, NULL);
+}
+
+// RvDpuRunPar hands all but the caller's share of tasklets to these threads,
+// which stay parked between launches. There are always at least as many idle
+// as queued shares, so a share never waits behind another DPU's.
+struct tcPar {
+  RvDpu *D;
+  uint32_t Mine;
+  RvTcShare *Sh;
+  uint32_t *NrLeft; // Shares of the launch still running, futex
+  struct tcPar *Next;
+};
+static struct {
+  pthread_mutex_t Mu;
+  pthread_cond_t Work;
+  struct tcPar *Head, **Tail;
+  size_t NrIdle, NrQueued;
+} tcPool = {PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, NULL,
+            &tcPool.Head, 0, 0};
+
+static void *tcPoolRun(void *arg) {
+  (void)arg;
+  pthread_mutex_lock(&tcPool.Mu);
+  for (;;) {
+    while (tcPool.Head == NULL)
+      pthread_cond_wait(&tcPool.Work, &tcPool.Mu);
+    struct tcPar *p = tcPool.Head;
+    if ((tcPool.Head = p->Next) == NULL) tcPool.Tail = &tcPool.Head;
+    --tcPool.NrQueued;
+    --tcPool.NrIdle;
+    pthread_mutex_unlock(&tcPool.Mu);
+    rvTc(p->D, p->Mine, p->Sh, NULL, NULL);
+    // p lives on the caller's stack, gone once the count drops to 0
+    uint32_t *nrLeft = p->NrLeft;
+    if (__atomic_sub_fetch(nrLeft, 1, __ATOMIC_SEQ_CST) == 0)
+      syscall(SYS_futex, nrLeft, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+    pthread_mutex_lock(&tcPool.Mu);
+    ++tcPool.NrIdle;
+  }
+  return NULL;
+}
+
+// Queue up to nr shares, starting threads as needed; returns how many
+static size_t tcPoolPost(struct tcPar *ps, size_t nr) {
+  pthread_mutex_lock(&tcPool.Mu);
+  while (tcPool.NrIdle < tcPool.NrQueued + nr) {
+    pthread_t th;
+    if (pthread_create(&th, NULL, tcPoolRun, NULL) != 0) {
+      nr = tcPool.NrIdle - tcPool.NrQueued;
+      break;
+    }
+    pthread_detach(th);
+    ++tcPool.NrIdle;
+  }
+  for (size_t i = 0; i < nr; ++i) {
+    ps[i].Next = NULL;
+    *tcPool.Tail = &ps[i];
+    tcPool.Tail = &ps[i].Next;
+  }
+  tcPool.NrQueued += nr;
+  if (nr > 1)
+    pthread_cond_broadcast(&tcPool.Work);
+  else if (nr == 1)
+    pthread_cond_signal(&tcPool.Work);
+  pthread_mutex_unlock(&tcPool.Mu);
+  return nr;
+}
+
+void RvDpuRunPar(RvDpu *d, size_t nrTasklets, size_t nrThrd) {
+  if (nrThrd > nrTasklets) nrThrd = nrTasklets;
+  if (nrThrd <= 1 || d->Program.Tc == NULL
+#ifdef __DMM_RV_JIT
+      || d->Program.Jit != NULL
+#endif
+  ) {
+    RvDpuRun(d, nrTasklets);
+    return;
+  }
+  RvDpuStart(d, nrTasklets);
+  // Tasklet i goes to share i % nrThrd; share 0, the caller's, has tasklet 0
+  // and polls the mailbox
+  RvTcShare sh = {.All = (1u << nrTasklets) - 1, .NrPark = 0};
+  struct tcPar ps[MaxNumTasklets];
+  uint32_t nrLeft = nrThrd - 1;
+  for (size_t t = 0; t < nrThrd; ++t) {
+    ps[t] = (struct tcPar){.D = d, .Mine = 0, .Sh = &sh, .NrLeft = &nrLeft};
+    for (size_t i = t; i < nrTasklets; i += nrThrd)
+      ps[t].Mine |= 1u << i;
+  }
+  size_t nrPosted = tcPoolPost(&ps[1], nrThrd - 1);
+  // Shares no thread could take are the caller's
+  for (size_t t = 1 + nrPosted; t < nrThrd; ++t)
+    ps[0].Mine |= ps[t].Mine;
+  __atomic_sub_fetch(&nrLeft, nrThrd - 1 - nrPosted, __ATOMIC_SEQ_CST);
+  rvTc(d, ps[0].Mine, &sh, NULL, NULL);
+  for (uint32_t n; (n = __atomic_load_n(&nrLeft, __ATOMIC_SEQ_CST)) != 0;)
+    syscall(SYS_futex, &nrLeft, FUTEX_WAIT_PRIVATE, n, NULL, NULL, 0);
+  DmmMailboxClose(&d->Mailbox, d->Program.WMAram);
+}
@@ -61,6 +61,53 @@ static void serveCycleRule(RvTiming *this) {
   this->CrExtraCycleLeft -= 1;
 }
 
+#ifdef __DMM_EVENT_DRIVEN
+// While every awake tasklet waits on MRAM and only bubbles are in flight,
+// logic cycles are plain stalls until the MRAM model acks a tasklet. Step
+// only the MRAM model through them and account the stalls at once.
+static void fastForward(RvTiming *this, size_t nrTasklets) {
+  if (this->PpInInstr != (RvInstr *)1 || this->PpReadyInstr != (RvInstr *)1 ||
+      this->CrCurInstr != NULL || this->CrPrevInstr != NULL ||
+      this->lastIssue >= nrTasklets || this->MramTiming.NrWait == 0 ||
+      DmmMramTimingCanPop(&this->MramTiming))
+    return;
+  uint32_t awake = this->Csr[0] & ((1u << nrTasklets) - 1);
+  if (awake & ~this->Csr[31])
+    return;
+  if (((this->PpQRear - this->PpQFrt) & 15) != NrPipelineStage - 2)
+    return;
+  for (uint_fast8_t i = this->PpQFrt; i != this->PpQRear; i = (i + 1) & 15)
+    if (this->PpInsideInstrs[i] != (RvInstr *)1)
+      return;
+  // Also wait out revolve windows so that every skipped cycle scans alike
+  uint32_t cool = this->revolver.Mask & ~DmmRevolverExpiring(
+      &this->revolver, this->lastRunAt, this->TotNrCycle + 1);
+  if (cool & ((1u << nrTasklets) - 1))
+    return;
+
+  // The ack lands after the scheduler scan, so its cycle is a stall as well
+  long nrCycle = DmmMramTimingRunToAck(&this->MramTiming, this->FreqRatio,
+                                       this->TotNrCycle);
+  this->TotNrCycle += nrCycle;
+  this->StatNrCycle += nrCycle;
+  if (awake & this->Csr[31])
+    this->StatDma += nrCycle;
+  else
+    this->StatEtc += nrCycle;
+  for (long i = 0; i < nrCycle && i < 16; i++) {
+    uint_fast8_t at = (this->PpQRear + i) & 15;
+    this->PpInsideInstrs[at] = (RvInstr *)1;
+    this->PpInsideIds[at] = this->PpInId;
+  }
+  this->PpQRear = (this->PpQRear + nrCycle) & 15;
+  this->PpQFrt = (this->PpQFrt + nrCycle) & 15;
+  this->PpReadyId = this->PpInsideIds[(this->PpQFrt - 1) & 15];
+  this->CrExtraCycleLeft -= nrCycle;
+  DmmRevolverSkip(&this->revolver, this->lastRunAt, this->TotNrCycle);
+  this->Csr[31] &= ~(1 << DmmMramTimingPop(&this->MramTiming));
+}
+#endif
+
 void RvTimingInit(RvTiming *t, RvInstr *iram, size_t memFreq,
                    size_t logicFreq) {
   memset(t, 0, sizeof(RvTiming));
@@ -73,6 +120,7 @@ void RvTimingInit(RvTiming *t, RvInstr *iram, size_t memFreq,
   }
   t->FreqRatio = (double)memFreq / (double)logicFreq;
   DmmMramTimingInit(&t->MramTiming);
+  DmmRevolverInit(&t->revolver);
 
   // Push dummy entries to simulate initial pipeline stages
   for (size_t i = 0; i < NrPipelineStage - 1; i++) {
@@ -86,37 +134,47 @@ void RvTimingInit(RvTiming *t, RvInstr *iram, size_t memFreq,
 }
 
 RvTlet *RvTimingCycle(RvTiming *this, size_t nrTasklets) {
-  long num_memory_cycles =
-      (long)(this->FreqRatio * (double)this->TotNrCycle -
-             this->FreqRatio * (double)(this->TotNrCycle - 1));
+#ifdef __DMM_EVENT_DRIVEN
+  fastForward(this, nrTasklets);
+#endif
+  long num_memory_cycles = DmmMramCyclesAt(this->FreqRatio, this->TotNrCycle);
+#ifdef __DMM_EVENT_DRIVEN
+  DmmMramTimingRun(&this->MramTiming, num_memory_cycles);
+#else
   for (long i = 0; i < num_memory_cycles; i++)
     DmmMramTimingCycle(&this->MramTiming);
+#endif
   this->TotNrCycle++;
   this->StatNrCycle++;
+  DmmRevolverTick(&this->revolver, this->lastRunAt, this->TotNrCycle);
   RvTlet *ret = NULL;
 
   if (this->PpInInstr != (RvInstr *)1 || this->CrCurInstr != NULL) {
     this->StatNrRfHazard += 1;
   } else {
-    bool is_blocked = false;
-    for (long i = 0; i < nrTasklets; i++) {
-      RvTlet *thread = &this->Threads[this->lastIssue];
-      this->lastIssue++;
-      if (this->lastIssue == nrTasklets) this->lastIssue = 0;
-      if (this->lastRunAt[this->lastIssue] + NrRevolveCycle >
-          this->TotNrCycle)
-        continue;
-
-      // Check if thread is sleeping or blocked via CSR bits
-      if (!((this->Csr[0] >> thread->Id) & 1)) // sleeping
-        continue;
-      if ((this->Csr[31] >> thread->Id) & 1) { // blocked
-        is_blocked = true; continue;
-      }
-
-      size_t pc = (thread->Pc - IramBeginR) / InstrNrByteR;
-      if (pc >= IramNrInstrR)
-        continue; // PC out of bounds
+    // Scan order starts at lastIssue, and tasklet i checks the revolve
+    // window of tasklet i+1. Masks below are rotated to scan order.
+    uint32_t all = (1u << nrTasklets) - 1;
+    unsigned from = this->lastIssue;
+    uint32_t open = ~DmmRotMask(this->revolver.Mask & all, 1 % nrTasklets,
+                                nrTasklets) & all;
+    uint32_t awake = open & this->Csr[0]; // Sleeping tasklets are passed
+    uint32_t run = DmmRotMask(awake & ~this->Csr[31], from, nrTasklets);
+    uint32_t blocked = DmmRotMask(awake & this->Csr[31], from, nrTasklets);
+    RvTlet *thread = NULL;
+    size_t pc;
+    for (; run != 0; run &= run - 1) {
+      thread = &this->Threads[(from + __builtin_ctz(run)) % nrTasklets];
+      pc = (thread->Pc - IramBeginR) / InstrNrByteR;
+      if (pc < IramNrInstrR)
+        break;
+      thread = NULL; // PC out of bounds
+    }
+    if (run != 0)
+      blocked &= (1u << __builtin_ctz(run)) - 1;
+    bool is_blocked = blocked != 0;
+    if (thread != NULL) {
+      this->lastIssue = (thread->Id + 1) % nrTasklets;
 
       RvInstr *instr = &this->Iram[pc];
       this->PpInInstr = instr;
@@ -164,10 +222,10 @@ RvTlet *RvTimingCycle(RvTiming *this, size_t nrTasklets) {
       this->lastPc[this->lastIssue] = pc;
 #endif
       this->lastRunAt[this->lastIssue] = this->TotNrCycle;
+      DmmRevolverSet(&this->revolver, this->lastIssue, this->TotNrCycle);
       this->StatNrInstrExec += 1;
       this->StatRun += 1;
       ret = thread;
-      break;
     }
     if (is_blocked)
       this->StatDma += 1;
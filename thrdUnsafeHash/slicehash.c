@@ -1,4 +1,6 @@
 #include "hashmap.h"
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 struct user {
@@ -19,24 +21,86 @@ static int user_compare(const void *a, const void *b, void *udata) {
   return memcmp(ua->name, ub->name, ua->sz);
 }
 
-typedef struct hashmap* DmmMap;
+// Keys copied by DmmMapAssignCopy, bump allocated, freed with the map
+struct names {
+  struct names *next;
+  size_t used, cap;
+  char at[];
+};
+enum { namesCap = 16384 };
+typedef struct dmmMap {
+  struct hashmap *h;
+  struct names *names;
+} *DmmMap;
+
 DmmMap DmmMapInit(size_t initCap) {
   static uint64_t seed1 = 1234567, seed2 = 0x890abcd;
-  struct hashmap *map = hashmap_new(sizeof(struct user), initCap, seed1, seed2,
-                                    user_hash, user_compare, NULL, NULL);
+  DmmMap map = malloc(sizeof(struct dmmMap));
+  if (map == NULL)
+    return NULL;
+  map->h = hashmap_new(sizeof(struct user), initCap, seed1, seed2,
+                       user_hash, user_compare, NULL, NULL);
+  map->names = NULL;
   seed1 *= seed2;
   seed2 ^= seed1;
+  if (map->h == NULL) {
+    free(map);
+    return NULL;
+  }
   return map;
 }
 void DmmMapAssign(DmmMap map, const void *str, size_t sz,
                        uint_fast32_t val) {
-  hashmap_set(map, &(struct user){ .name=str, .sz=sz, .value=val });
+  hashmap_set(map->h, &(struct user){ .name=str, .sz=sz, .value=val });
+}
+void DmmMapAssignCopy(DmmMap map, const void *str, size_t sz,
+                      uint_fast32_t val) {
+  struct names *n = map->names;
+  if (n == NULL || n->cap - n->used < sz) {
+    size_t cap = sz > namesCap ? sz : namesCap;
+    n = malloc(sizeof(struct names) + cap);
+    if (n == NULL) {
+      perror("malloc symbol names");
+      exit(EXIT_FAILURE);
+    }
+    n->next = map->names; n->used = 0; n->cap = cap;
+    map->names = n;
+  }
+  char *copy = n->at + n->used;
+  memcpy(copy, str, sz);
+  n->used += sz;
+  DmmMapAssign(map, copy, sz, val);
 }
 uint_fast32_t DmmMapFetch(DmmMap map, const void* str, size_t sz) {
   struct user u = { .name=str, .sz=sz };
-  struct user *a = (struct user*)hashmap_get(map, &u);
+  struct user *a = (struct user*)hashmap_get(map->h, &u);
   return a != NULL ? a->value : 0x44f8a1ef;
 }
-void DmmMapFini(DmmMap map) { hashmap_free(map); }
-void DmmMapClear(DmmMap map) { hashmap_clear(map, true); }
+bool DmmMapIter(DmmMap map, size_t *at, const void **str, size_t *sz,
+                uint_fast32_t *val) {
+  void *item;
+  if (!hashmap_iter(map->h, at, &item))
+    return false;
+  const struct user *u = item;
+  *str = u->name; *sz = u->sz; *val = u->value;
+  return true;
+}
+static void freeNames(DmmMap map) {
+  while (map->names != NULL) {
+    struct names *next = map->names->next;
+    free(map->names);
+    map->names = next;
+  }
+}
+void DmmMapFini(DmmMap map) {
+  if (map == NULL)
+    return;
+  hashmap_free(map->h);
+  freeNames(map);
+  free(map);
+}
+void DmmMapClear(DmmMap map) {
+  hashmap_clear(map->h, true);
+  freeNames(map);
+}
 
@@ -7,27 +7,300 @@
 
 #include "dpu.h"
 #include "downmem.h"
-#include <omp.h>
+#include <pthread.h>
+#include <stdlib.h>
 #include <sys/mman.h>
+#include <time.h>
 #include <unistd.h>
 
 // .bss 0init all global and static vars
 struct DmmDpuRecord DmmDpuRecords[2048];
 atomic_size_t NrDmmDpuRecord, DmmTotExecUsec, DmmTotXferUsec;
+atomic_size_t DmmTotParallelXferUsec;
 _Thread_local size_t DmmLastRecordIdx;
+size_t DmmSimThrdBusyUsec[DmmMaxNrSimThrd];
+size_t DmmSimThrdIdleUsec[DmmMaxNrSimThrd];
 
 static size_t nrCore, logicFreq, memFreq;
+// DPUs a simulation thread runs round-robin in dpu_launch, 1 for one at a
+// time; from DMM_NR_INTERLEAVE
+enum { _maxNrInterleave = 16, _interleaveNrCycle = 4096 };
+static size_t nrInterleave;
+#ifdef __DMM_FUNCTIONAL_ONLY
+// Host threads that may share the tasklets of one riscv DPU in dpu_launch
+// when the set leaves cores idle, 0 for up to NR_TASKLETS; from
+// DMM_NR_TL_THRDS. Only DPUs expected to run _tlThrdMinUsec or more, or not
+// launched yet, are split, since waking the parked threads is not free.
+enum { _tlThrdMinUsec = 2000 };
+static size_t nrTlThrd;
+#endif
 static size_t dmmDpuSize;
 #ifdef __DMM_TSCDUMP
 static char* dumpFile;
 #endif
 #ifdef __DMM_NUMA
-static cpu_set_t t0aff;
+static int coreNode[DmmMaxNrSimThrd];
 #endif
 static inline struct DmmDpu* _dptr(size_t i, struct dpu_set_t s) {
   return (struct DmmDpu*)((uintptr_t)s.dmm_dpu + dmmDpuSize * i);
 }
 
+static inline double _wallSec(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// --- Simulation worker pool ---
+// nrCore threads, started on first use; with NUMA worker i is pinned to CPU
+// i. Each job works on the DPUs of one set and opens once every job
+// submitted before it on overlapping DPUs is done, so jobs on disjoint sets,
+// say from different host threads, run side by side. A free worker joins
+// the open job with the fewest workers and runs fn(arg, me), which returns
+// true once the job has no work left to take; fn calls _poolYield between
+// DPUs to leave a crowded job for a starved one. Once a job is drained and
+// its last worker is out, that worker runs fini(arg). Calls touching the
+// DPUs of a set wait for its jobs with _poolWait. Workers spin a little
+// before sleeping since iterative apps submit many short jobs back to back.
+// A job takes at most MaxIn workers, sized by _poolWidth, and opening it
+// wakes no more than that.
+typedef bool (*_poolFn)(void *arg, size_t me);
+struct _poolJob {
+  struct _poolJob *Next;
+  struct dpu_set_t On;
+  _poolFn Fn;
+  void (*Fini)(void *arg);
+  void *Arg;
+  size_t MaxIn;
+  atomic_size_t NrIn; // Workers in fn, changed under pool.Mu
+  bool Open, Drained;
+};
+static struct {
+  pthread_once_t Once;
+  pthread_mutex_t Mu;
+  pthread_cond_t Start, Done;
+  struct _poolJob *Head, *Tail; // Submission order, guarded by Mu
+  atomic_size_t NrOpen; // Open jobs not drained yet, changed under Mu
+  atomic_size_t Gen;    // Bumped whenever a job opens
+  int NrSpin;           // Pauses before sleeping, none if oversubscribed
+  // When each worker ran out of work while jobs were left, 0 if it did not
+  double IdleSince[DmmMaxNrSimThrd];
+} pool = {PTHREAD_ONCE_INIT, PTHREAD_MUTEX_INITIALIZER,
+          PTHREAD_COND_INITIALIZER, PTHREAD_COND_INITIALIZER};
+static _Thread_local struct _poolJob *curJob;
+
+static inline void _spinPause(void) {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#endif
+}
+
+static inline bool _overlap(struct dpu_set_t a, struct dpu_set_t b) {
+  return a.dmm_dpu == b.dmm_dpu && a.begin < b.end && b.begin < a.end;
+}
+// Whether a queued job works on DPUs of set; caller holds pool.Mu
+static inline bool _poolOn(struct dpu_set_t set) {
+  for (struct _poolJob *j = pool.Head; j != NULL; j = j->Next)
+    if (_overlap(j->On, set))
+      return true;
+  return false;
+}
+
+// Open every job no earlier job overlaps; caller holds pool.Mu
+static void _poolOpen(void) {
+  size_t nrWake = 0;
+  for (struct _poolJob *j = pool.Head; j != NULL; j = j->Next) {
+    if (j->Open)
+      continue;
+    struct _poolJob *e = pool.Head;
+    while (e != j && !_overlap(e->On, j->On))
+      e = e->Next;
+    if (e != j)
+      continue;
+    j->Open = true;
+    nrWake += j->MaxIn;
+    atomic_fetch_add_explicit(&pool.NrOpen, 1, memory_order_relaxed);
+  }
+  if (nrWake == 0)
+    return;
+  atomic_fetch_add_explicit(&pool.Gen, 1, memory_order_release);
+  if (nrWake >= nrCore)
+    pthread_cond_broadcast(&pool.Start);
+  else while (nrWake-- > 0)
+    pthread_cond_signal(&pool.Start);
+}
+
+// The open job with the fewest workers, the earliest on ties, among those
+// short of MaxIn; caller holds pool.Mu
+static struct _poolJob *_poolPick(void) {
+  struct _poolJob *pick = NULL;
+  for (struct _poolJob *j = pool.Head; j != NULL; j = j->Next)
+    if (j->Open && !j->Drained && j->NrIn < j->MaxIn &&
+        (pick == NULL || j->NrIn < pick->NrIn))
+      pick = j;
+  return pick;
+}
+
+// Unlink a finished job and open the ones it held back; caller holds
+// pool.Mu. Once no job is left, idle workers stop counting.
+static void _poolRetire(struct _poolJob *job) {
+  struct _poolJob **at = &pool.Head, *prev = NULL;
+  while (*at != job) {
+    prev = *at;
+    at = &(*at)->Next;
+  }
+  *at = job->Next;
+  if (pool.Tail == job)
+    pool.Tail = prev;
+  _poolOpen();
+  pthread_cond_broadcast(&pool.Done);
+  if (pool.Head != NULL)
+    return;
+  double now = _wallSec();
+  for (size_t i = 0; i < nrCore; ++i)
+    if (pool.IdleSince[i] != 0) {
+      DmmSimThrdIdleUsec[i] += (now - pool.IdleSince[i]) * 1e6;
+      pool.IdleSince[i] = 0;
+    }
+}
+
+// Whether the calling worker should leave its job: it has more than its
+// share of the workers while another job is open
+static bool _poolYield(void) {
+  size_t nrOpen = atomic_load_explicit(&pool.NrOpen, memory_order_relaxed);
+  size_t nrIn = atomic_load_explicit(&curJob->NrIn, memory_order_relaxed);
+  return nrOpen > 1 && nrIn * nrOpen > nrCore + nrOpen - 1;
+}
+
+static void *_poolWorker(void *arg) {
+  size_t me = (size_t)arg;
+#ifdef __DMM_NUMA
+  cpu_set_t cpuset; CPU_ZERO(&cpuset); CPU_SET(me, &cpuset);
+  if (sched_setaffinity(0, sizeof(cpu_set_t), &cpuset) != 0)
+    perror("sched_setaffinity");
+#endif
+  pthread_mutex_lock(&pool.Mu);
+  for (;;) {
+    struct _poolJob *job = _poolPick();
+    if (job == NULL) {
+      // Nothing to take: idle if others still work on jobs, then wait for
+      // one to open
+      if (pool.Head != NULL && pool.IdleSince[me] == 0)
+        pool.IdleSince[me] = _wallSec();
+      size_t seen = atomic_load_explicit(&pool.Gen, memory_order_relaxed);
+      pthread_mutex_unlock(&pool.Mu);
+      for (int i = 0; i < pool.NrSpin; ++i) {
+        if (atomic_load_explicit(&pool.Gen, memory_order_acquire) != seen)
+          break;
+        _spinPause();
+      }
+      pthread_mutex_lock(&pool.Mu);
+      while (atomic_load_explicit(&pool.Gen, memory_order_acquire) == seen)
+        pthread_cond_wait(&pool.Start, &pool.Mu);
+      continue;
+    }
+    if (pool.IdleSince[me] != 0) {
+      DmmSimThrdIdleUsec[me] += (_wallSec() - pool.IdleSince[me]) * 1e6;
+      pool.IdleSince[me] = 0;
+    }
+    atomic_fetch_add_explicit(&job->NrIn, 1, memory_order_relaxed);
+    pthread_mutex_unlock(&pool.Mu);
+    curJob = job;
+    bool drained = job->Fn(job->Arg, me);
+    pthread_mutex_lock(&pool.Mu);
+    if (drained && !job->Drained) {
+      job->Drained = true;
+      atomic_fetch_sub_explicit(&pool.NrOpen, 1, memory_order_relaxed);
+    }
+    if (atomic_fetch_sub_explicit(&job->NrIn, 1, memory_order_relaxed) == 1 &&
+        job->Drained) {
+      pthread_mutex_unlock(&pool.Mu);
+      if (job->Fini != NULL)
+        job->Fini(job->Arg);
+      pthread_mutex_lock(&pool.Mu);
+      _poolRetire(job);
+      free(job);
+    }
+  }
+  return NULL;
+}
+
+static void _poolSpawn(void) {
+  pool.NrSpin = nrCore <= sysconf(_SC_NPROCESSORS_ONLN) ? 1 << 12 : 0;
+  pthread_attr_t attr;
+  pthread_attr_init(&attr);
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+  for (size_t i = 0; i < nrCore; ++i) {
+    pthread_t t;
+    if (pthread_create(&t, &attr, _poolWorker, (void*)i) != 0)
+      exit(fprintf(stderr, "Failed to start simulation worker %zu\n", i));
+  }
+  pthread_attr_destroy(&attr);
+}
+
+// Wait until no queued job touches the DPUs of set
+static void _poolWait(struct dpu_set_t set) {
+  pthread_mutex_lock(&pool.Mu);
+  while (_poolOn(set))
+    pthread_cond_wait(&pool.Done, &pool.Mu);
+  pthread_mutex_unlock(&pool.Mu);
+}
+
+// Queue a job on the DPUs of set behind every job submitted before on the
+// same DPUs; returns at once. fini may free arg.
+static dpu_error_t _poolSubmit(struct dpu_set_t set, _poolFn fn,
+                               void (*fini)(void *arg), void *arg,
+                               size_t maxIn) {
+  struct _poolJob *job = malloc(sizeof(struct _poolJob));
+  if (job == NULL) return DPU_ERR_SYSTEM;
+  *job = (struct _poolJob){NULL, set, fn, fini, arg, maxIn};
+  pthread_once(&pool.Once, _poolSpawn);
+  pthread_mutex_lock(&pool.Mu);
+  if (pool.Tail != NULL)
+    pool.Tail = pool.Tail->Next = job;
+  else
+    pool.Head = pool.Tail = job;
+  _poolOpen();
+  pthread_mutex_unlock(&pool.Mu);
+  return DPU_OK;
+}
+
+static dpu_error_t _poolRun(struct dpu_set_t set, _poolFn fn, void *arg,
+                            size_t maxIn) {
+  dpu_error_t ret = _poolSubmit(set, fn, NULL, arg, maxIn);
+  _poolWait(set);
+  return ret;
+}
+
+// Workers worth waking for nrDpu DPUs taking workUsec of host time in all,
+// 0 if not known yet: each should get _poolMinSliceUsec of work or more, as
+// waking one costs some. A job worth one worker runs on the calling thread
+// when synchronous.
+enum { _poolMinSliceUsec = 64 };
+static size_t _poolWidth(size_t nrDpu, double workUsec) {
+  size_t width = nrDpu < nrCore ? nrDpu : nrCore;
+  if (workUsec > 0 && workUsec < (double)width * _poolMinSliceUsec)
+    width = workUsec / _poolMinSliceUsec;
+  return width > 0 ? width : 1;
+}
+
+// Worker me handles DPUs me, me + nrCore, ..., which dpu_alloc bound to
+// the NUMA node of CPU me
+static inline size_t _firstDpu(struct dpu_set_t set, size_t me) {
+  return set.begin + (me + nrCore - set.begin % nrCore) % nrCore;
+}
+
+// Take the next DPUs [*first, *end) of a job handing out the DPUs of set in
+// chunks from *next on; small enough for late workers to share the job
+static inline bool _chunkTake(atomic_size_t *next, struct dpu_set_t set,
+                              size_t *first, size_t *end) {
+  size_t nr = (set.end - set.begin + 8 * nrCore - 1) / (8 * nrCore);
+  *first = atomic_fetch_add_explicit(next, nr, memory_order_relaxed);
+  if (*first >= set.end) return false;
+  *end = *first + nr < set.end ? *first + nr : set.end;
+  return true;
+}
+
 dpu_error_t dpu_alloc(uint32_t nrDpu, const char *_, struct dpu_set_t *set) {
   if (set == NULL) return DPU_ERR_ALLOCATION;
   if (nrDpu == 0) return DPU_ERR_ALLOCATION;
@@ -73,13 +346,89 @@ dpu_error_t dpu_alloc_ranks(uint32_t nrRank, const char *_,
   return dpu_alloc(nrRank * 64, _, set);
 }
 
+// WMAram of a DPU with a program, for the pool's bookkeeping
+static void _wmaTouch(struct DmmDpu *dpu) {
+  if (dpu->Is == RV_DPUIS) DmmWmaTouch(dpu->R.Program.WMAram, WMAINrByteR);
+  else DmmWmaTouch(dpu->U.Program.WMAram, WMAINrByte);
+}
+static void _mramHigh(struct DmmDpu *dpu) {
+  size_t nrByte = 0;
+  if (dpu->Is == RV_DPUIS)
+    nrByte = DmmWmaHighWater(dpu->R.Program.WMAram, WMAINrByteR,
+                             WramSizeR, WramSizeR + MramSizeR);
+  else if (dpu->Is == UMM_DPUIS)
+    nrByte = DmmWmaHighWater(dpu->U.Program.WMAram, WMAINrByte,
+                             WramSize, WramSize + MramSize);
+  if (dpu->MramHighKb < nrByte / 1024)
+    dpu->MramHighKb = nrByte / 1024;
+}
+
+// A program as dpu_load left it on a set: IRAM replicas on the NUMA nodes
+// its DPUs are homed on and the threaded code or JIT built from it. Each DPU
+// loaded with it holds a reference, so that loading another program on part
+// of the set leaves the rest running this one; the last to drop it frees it.
+struct DmmSharedPrg {
+  atomic_size_t NrRef;
+  bool IsRv;
+  const RvTcInstr *Rtc;
+  const UmmTcInstr *Utc;
+#ifdef __DMM_RV_JIT
+  const RvJit *Rjit;
+#endif
+  int NrNode;
+  void *Iram[]; // Per node, NULL where no DPU of the set is homed
+};
+
+// The node whose IRAM replica DPU dpuId runs
+static inline int _iramNode(size_t dpuId, int nrNode) {
+#ifdef __DMM_NUMA
+  int node = coreNode[dpuId % nrCore];
+  return node >= 0 && node < nrNode ? node : 0;
+#else
+  (void)dpuId; (void)nrNode;
+  return 0;
+#endif
+}
+
+static void _sharedDrop(struct DmmDpu *dpu) {
+  struct DmmSharedPrg *s = dpu->Shared;
+  if (s == NULL)
+    return;
+  dpu->Shared = NULL;
+  if (dpu->Is == RV_DPUIS) {
+    dpu->R.Program.Iram = dpu->R.Timing.Iram = NULL;
+    dpu->R.Program.Tc = NULL;
+#ifdef __DMM_RV_JIT
+    dpu->R.Program.Jit = NULL;
+#endif
+  } else {
+    dpu->U.Program.Iram = dpu->U.Timing.Iram = NULL;
+    dpu->U.Program.Tc = NULL;
+  }
+  if (atomic_fetch_sub(&s->NrRef, 1) != 1)
+    return;
+  for (int n = 0; n < s->NrNode; ++n) {
+    if (s->Iram[n] == NULL) continue;
+    if (s->IsRv) RvIramFree(s->Iram[n]); else UmmIramFree(s->Iram[n]);
+  }
+  free((void*)s->Rtc);
+  free((void*)s->Utc);
+#ifdef __DMM_RV_JIT
+  if (s->Rjit != NULL) RvJitFree((RvJit*)s->Rjit);
+#endif
+  free(s);
+}
+
 static void _unload(struct dpu_set_t set) {
 #ifdef __DMM_TSCDUMP
-  static size_t nrDump = 0;
+  static atomic_size_t nrDump = 0;
   if (dumpFile != NULL) {
-    struct DmmDpu *firstDpu = (struct DmmDpu*)set.dmm_dpu;
-    size_t nthDump = nrDump++, nrInstr = 0;
-    for (size_t i = 0; i < IramNrInstrR; ++i) {
+    struct DmmDpu *firstDpu = _dptr(set.begin, set);
+    size_t nthDump = atomic_fetch_add(&nrDump, 1), nrInstr = 0;
+    // Before the first dpu_load there is no IRAM, so nothing to dump
+    bool loaded = firstDpu->Is == RV_DPUIS ? firstDpu->R.Program.Iram != NULL :
+                  firstDpu->Is == UMM_DPUIS && firstDpu->U.Program.Iram != NULL;
+    for (size_t i = 0; loaded && i < IramNrInstrR; ++i) {
       bool hasInstr = firstDpu->Is == RV_DPUIS ?
         (firstDpu->R.Program.Iram[i].Opcode != 0) :
         (firstDpu->U.Program.Iram[i].Opcode != 0);
@@ -92,8 +441,9 @@ static void _unload(struct dpu_set_t set) {
     if (dump == NULL) return DPU_ERR_VPD_INVALID_FILE;
 
     for (size_t i = set.begin; nrInstr != 0 && i < set.end; ++i) {
-      fprintf(dump, "DPU %zu\n", i);
       struct DmmDpu* d = _dptr(i, set);
+      _mramHigh(d);
+      fprintf(dump, "DPU %zu MRAM high-water %uKB\n", i, d->MramHighKb);
       for (size_t j = 0; j < nrInstr; ++j) {
         if (d->Is == RV_DPUIS) {
           fprintf(dump, "%04zx %u %s\n", j * InstrNrByteR, d->R.Timing.StatTsc[j],
@@ -108,12 +458,33 @@ static void _unload(struct dpu_set_t set) {
     fclose(dump);
   }
 #endif
+
+  for (size_t i = set.begin; i < set.end; ++i)
+    _sharedDrop(_dptr(i, set));
 }
 
 dpu_error_t dpu_free(struct dpu_set_t set) {
+  _poolWait(set);
   _unload(set);
   printf("Freed %zu DPU, Exec %zuusec, Xfer %zuusec till now\n",
          set.end - set.begin, DmmTotExecUsec, DmmTotXferUsec);
+  size_t maxBusy = 0, maxIdle = 0, sumBusy = 0, sumIdle = 0;
+  for (size_t i = 0; i < nrCore; ++i) {
+    if (maxBusy < DmmSimThrdBusyUsec[i]) maxBusy = DmmSimThrdBusyUsec[i];
+    if (maxIdle < DmmSimThrdIdleUsec[i]) maxIdle = DmmSimThrdIdleUsec[i];
+    sumBusy += DmmSimThrdBusyUsec[i]; sumIdle += DmmSimThrdIdleUsec[i];
+  }
+  printf("Sim threads busy/idle: max %zu/%zuusec, sum %zu/%zuusec\n",
+         maxBusy, maxIdle, sumBusy, sumIdle);
+  size_t maxMram = 0, sumMram = 0;
+  for (size_t i = set.begin; i < set.end; ++i) {
+    struct DmmDpu *d = _dptr(i, set);
+    _mramHigh(d);
+    if (maxMram < d->MramHighKb) maxMram = d->MramHighKb;
+    sumMram += d->MramHighKb;
+  }
+  printf("MRAM high-water: max %zuKB, mean %zuKB\n",
+         maxMram, sumMram / (set.end - set.begin));
   for (size_t i = set.begin; i < set.end; ++i) {
     struct DmmDpu* d = _dptr(i, set);
     if (d->Is == UMM_DPUIS) UmmDpuFini(&d->U);
@@ -125,98 +496,367 @@ dpu_error_t dpu_free(struct dpu_set_t set) {
   return DPU_OK;
 }
 
+// Set up the DPUs of a set, each for the NUMA node it is homed on
+struct _loadTask {
+  struct dpu_set_t Set;
+  atomic_size_t Next; // See _chunkTake
+  const uint8_t *PrgWma;
+  const bool *Paged;
+  DmmWmaCow Cow; // Mapped instead of copying Paged pages if Fd >= 0
+  bool IsRv;
+  struct DmmSharedPrg *Prg;
+};
+static void _loadDpu(struct _loadTask *t, size_t dpuId) {
+  DmmDpu *dpu = _dptr(dpuId, t->Set);
+#ifdef __DMM_NUMA
+  int numaNode = coreNode[dpuId % nrCore];
+#else
+  int numaNode = -1;
+#endif
+  void *iram = t->Prg->Iram[_iramNode(dpuId, t->Prg->NrNode)];
+  dpu->RunUsec = 0;
+  _mramHigh(dpu);
+  // Hand the previous program's WMAram back to the pool, which may give it
+  // right back zeroed
+  if (dpu->Is == RV_DPUIS) RvDpuFini(&dpu->R);
+  else if (dpu->Is == UMM_DPUIS) UmmDpuFini(&dpu->U);
+  if (t->IsRv) {
+    RvDpuInit(&dpu->R, memFreq, logicFreq, numaNode);
+    dpu->Is = RV_DPUIS;
+    uint8_t *dpuWma = dpu->R.Program.WMAram;
+    if (t->Cow.Fd >= 0)
+      DmmWmaCowMap(&t->Cow, dpuWma, WMAINrByteR);
+    else for (size_t i = 0; i < WMAINrPageR; ++i)
+      if (t->Paged[i])
+        memcpy(&dpuWma[i*4096], &t->PrgWma[i * 4096], 4096);
+    dpu->R.Program.Iram = dpu->R.Timing.Iram = iram;
+    dpu->R.Program.Tc = t->Prg->Rtc;
+#ifdef __DMM_RV_JIT
+    dpu->R.Program.Jit = t->Prg->Rjit;
+#endif
+  } else {
+    UmmDpuInit(&dpu->U, memFreq, logicFreq, numaNode);
+    dpu->Is = UMM_DPUIS;
+    uint8_t *dpuWma = dpu->U.Program.WMAram;
+    if (t->Cow.Fd >= 0)
+      DmmWmaCowMap(&t->Cow, dpuWma, WMAINrByte);
+    else for (size_t i = 0; i < WMAINrPage; ++i)
+      if (t->Paged[i])
+        memcpy(&dpuWma[i*4096], &t->PrgWma[i * 4096], 4096);
+    dpu->U.Program.Iram = dpu->U.Timing.Iram = iram;
+    dpu->U.Program.Tc = t->Prg->Utc;
+  }
+  dpu->Shared = t->Prg;
+  _wmaTouch(dpu);
+}
+static bool _loadDpus(void *arg, size_t me) {
+  struct _loadTask *t = arg;
+  for (size_t first, end; _chunkTake(&t->Next, t->Set, &first, &end);) {
+    for (size_t dpuId = first; dpuId < end; ++dpuId)
+      _loadDpu(t, dpuId);
+    if (_poolYield()) return false;
+  }
+  return true;
+}
+
 dpu_error_t dpu_load(struct dpu_set_t set, const char *objdmpPath, void **_) {
-  _unload(set);
-  DmmMapClear(set.symbols);
+  _poolWait(set);
+  // Parsed aside, so that a binary that fails to load leaves the set as is
+  DmmMap symbols = DmmMapInit(512);
+  if (symbols == NULL)
+    return DPU_ERR_ALLOCATION;
   bool paged[WMAINrPage];
-  UmmPrg uprg = {NULL, NULL}; RvPrg rprg = {NULL, NULL};
-  size_t nrInstr = UmmPrgLoadBinary(&uprg, objdmpPath, set.symbols, paged);
-  uint8_t *prgWma = uprg.WMAram;
+  UmmPrg uprg = {NULL, NULL, NULL}; RvPrg rprg = {NULL, NULL};
+  size_t nrInstr = DmmPrgCacheLoad(objdmpPath, &uprg, &rprg, symbols, paged);
+  uint8_t *prgWma = rprg.WMAram != NULL ? rprg.WMAram : uprg.WMAram;
+  if (nrInstr == 0) {
+    nrInstr = UmmPrgLoadBinary(&uprg, objdmpPath, symbols, paged);
+    prgWma = uprg.WMAram;
+    if (nrInstr == 0) {
+      nrInstr = RvPrgLoadBinary(&rprg, objdmpPath, symbols, paged);
+      prgWma = rprg.WMAram;
+    }
+    if (nrInstr != 0 && prgWma == rprg.WMAram)
+      DmmPrgCacheStore(objdmpPath, RV_DPUIS, rprg.Iram, nrInstr, prgWma,
+                       symbols, paged);
+    else if (nrInstr != 0)
+      DmmPrgCacheStore(objdmpPath, UMM_DPUIS, uprg.Iram, nrInstr, prgWma,
+                       symbols, paged);
+  }
   if (nrInstr == 0) {
-    if ((nrInstr = RvPrgLoadBinary(&rprg, objdmpPath, set.symbols, paged)) == 0)
-      return DPU_ERR_ELF_INVALID_FILE;
-    prgWma = rprg.WMAram;
+    if (uprg.Iram != NULL) UmmIramFree(uprg.Iram);
+    if (rprg.Iram != NULL) RvIramFree(rprg.Iram);
+    UmmPrgFini(&uprg); RvPrgFini(&rprg);
+    DmmMapFini(symbols);
+    return DPU_ERR_ELF_INVALID_FILE;
   }
+  _unload(set);
+  DmmMapClear(set.symbols);
+  const void *name; size_t nameNrByte; uint_fast32_t val;
+  for (size_t at = 0; DmmMapIter(symbols, &at, &name, &nameNrByte, &val);)
+    DmmMapAssignCopy(set.symbols, name, nameNrByte, val);
+  DmmMapFini(symbols);
 
+  bool isRv = prgWma == rprg.WMAram;
 #ifdef __DMM_NUMA
-  cpu_set_t cpuset; CPU_ZERO(&cpuset); CPU_SET(0, &cpuset);
-  if (sched_setaffinity(0, sizeof(cpu_set_t), &cpuset) != 0)
-    perror("sched_setaffinity");
-#endif
-  #pragma omp parallel num_threads(nrCore)
-  {
-    size_t dpuId = omp_get_thread_num();
-    while (dpuId < set.begin)
-      dpuId += nrCore;
-    while (dpuId < set.end) {
-      DmmDpu *dpu = _dptr(dpuId, set);
-      size_t coreId = dpuId % nrCore;
-#ifdef __DMM_NUMA
-      int numaNode = numa_node_of_cpu(coreId);
+  int nrNode = numa_max_node() + 1;
 #else
-      int numaNode = -1;
+  int nrNode = 1;
 #endif
-      if (prgWma == rprg.WMAram) {
-        RvDpuInit(&dpu->R, memFreq, logicFreq, numaNode);
-        dpu->Is = RV_DPUIS;
-        uint8_t *dpuWma = dpu->R.Program.WMAram;
-        for (size_t i = 0; i < WMAINrPageR; ++i)
-          if (paged[i])
-            memcpy(&dpuWma[i*4096], &prgWma[i * 4096], 4096);
-        for (size_t i = 0; i < nrInstr; ++i)
-          dpu->R.Program.Iram[i] = rprg.Iram[i];
-      } else {
-        UmmDpuInit(&dpu->U, memFreq, logicFreq, numaNode);
-        dpu->Is = UMM_DPUIS;
-        uint8_t *dpuWma = dpu->U.Program.WMAram;
-        for (size_t i = 0; i < WMAINrPage; ++i)
-          if (paged[i])
-            memcpy(&dpuWma[i*4096], &prgWma[i * 4096], 4096);
-        for (size_t i = 0; i < nrInstr; ++i)
-          dpu->U.Program.Iram[i] = uprg.Iram[i];
-      }
-      dpuId += nrCore;
-    }
+  struct DmmSharedPrg *prg = calloc(1, sizeof(*prg) + nrNode * sizeof(void*));
+  if (prg == NULL) {
+    perror("calloc DmmSharedPrg");
+    exit(EXIT_FAILURE);
   }
-#ifdef __DMM_NUMA
-  if (sched_setaffinity(0, sizeof(cpu_set_t), &t0aff) != 0)
-    perror("sched_setaffinity");
+  prg->NrRef = set.end - set.begin;
+  prg->IsRv = isRv;
+  prg->NrNode = nrNode;
+#if defined(__DMM_RV_JIT)
+  prg->Rjit = isRv ? RvJitBuild(rprg.Iram) : NULL;
+#elif defined(__DMM_FUNCTIONAL_ONLY)
+  prg->Rtc = isRv ? RvTcBuild(rprg.Iram) : NULL;
+#endif
+#ifdef __DMM_FUNCTIONAL_ONLY
+  prg->Utc = isRv ? NULL : UmmTcBuild(uprg.Iram);
 #endif
 
+  // Every DPU runs the same decoded program: keep one copy per NUMA node
+  // hosting DPUs of the set instead of one per DPU. Without NUMA the parsed
+  // IRAM is used directly. Nodes follow cores, so nrCore DPUs cover them all.
+  if (nrNode == 1 && isRv) {
+    prg->Iram[0] = rprg.Iram; rprg.Iram = NULL;
+  } else if (nrNode == 1) {
+    prg->Iram[0] = uprg.Iram; uprg.Iram = NULL;
+  } else for (size_t i = set.begin; i < set.end && i < set.begin + nrCore; ++i) {
+    int n = _iramNode(i, nrNode);
+    if (prg->Iram[n] != NULL) continue;
+    if (isRv) {
+      RvInstr *iram = RvIramAlloc(n);
+      memcpy(iram, rprg.Iram, nrInstr * sizeof(RvInstr));
+      prg->Iram[n] = iram;
+    } else {
+      UmmInstr *iram = UmmIramAlloc(n);
+      memcpy(iram, uprg.Iram, nrInstr * sizeof(UmmInstr));
+      prg->Iram[n] = iram;
+    }
+  }
+
+  struct _loadTask task = {set, set.begin, prgWma, paged, {.Fd = -1}, isRv,
+                           prg};
+  // Share large images copy-on-write rather than copying them to every DPU
+  if (set.end - set.begin > 1)
+    DmmWmaCowInit(&task.Cow, prgWma, task.IsRv ? WMAINrByteR : WMAINrByte,
+                  paged);
+  size_t width = _poolWidth(set.end - set.begin, 0);
+  dpu_error_t ret = DPU_OK;
+  if (width == 1)
+    for (size_t i = set.begin; i < set.end; ++i)
+      _loadDpu(&task, i);
+  else
+    ret = _poolRun(set, _loadDpus, &task, width);
+
+  DmmWmaCowFini(&task.Cow);
+  if (uprg.Iram != NULL) UmmIramFree(uprg.Iram);
+  if (rprg.Iram != NULL) RvIramFree(rprg.Iram);
   UmmPrgFini(&uprg); RvPrgFini(&rprg);
-  return DPU_OK;
+  return ret;
 }
 
-dpu_error_t dpu_launch(struct dpu_set_t set, dpu_launch_policy_t _) {
-  if (set.dmm_dpu[set.begin].Is == UNINIT_DPUIS)
-    return DPU_ERR_NO_PROGRAM_LOADED;
+// DPUs a simulation thread has yet to run in dpu_launch: the ones homed on
+// its core, First + k * nrCore for k in [head, tail). The owner takes from
+// the head and thieves from the tail; both ends share a word for one CAS.
+typedef struct {
+  _Alignas(64) _Atomic uint64_t HeadTail;
+  size_t First;
+} _dpuDeque;
+
+static bool _dequeTake(_dpuDeque *q, bool tail, size_t *dpuId) {
+  uint64_t ht = atomic_load_explicit(&q->HeadTail, memory_order_relaxed);
+  for (;;) {
+    uint32_t head = (uint32_t)ht, end = (uint32_t)(ht >> 32);
+    if (head >= end) return false;
+    uint64_t next = tail ? head | (uint64_t)(end - 1) << 32 : ht + 1;
+    if (atomic_compare_exchange_weak_explicit(&q->HeadTail, &ht, next,
+        memory_order_relaxed, memory_order_relaxed)) {
+      *dpuId = q->First + (tail ? end - 1 : head) * nrCore;
+      return true;
+    }
+  }
+}
+
+// Steal from the thread with most DPUs left, first on our own NUMA node so
+// that DPUs mostly run where dpu_alloc bound them
+static bool _steal(_dpuDeque *qs, size_t me, size_t *dpuId) {
+  for (int sameNode = 1; sameNode >= 0; --sameNode) {
+    for (;;) {
+      size_t victim = me, most = 0;
+      for (size_t i = 0; i < nrCore; ++i) {
 #ifdef __DMM_NUMA
-  cpu_set_t cpuset; CPU_ZERO(&cpuset); CPU_SET(0, &cpuset);
-  if (sched_setaffinity(0, sizeof(cpu_set_t), &cpuset) != 0)
-    perror("sched_setaffinity");
+        if (sameNode && coreNode[i] != coreNode[me]) continue;
 #endif
-  #pragma omp parallel num_threads(nrCore)
-  {
-    size_t dpuId = omp_get_thread_num();
-
-    size_t nrTl = DmmMapFetch(set.symbols, "NR_TASKLETS", 11);
-    if (nrTl == MapNoInt) nrTl = 1;
-    while (dpuId < set.begin)
-      dpuId += nrCore;
-    while (dpuId < set.end) {
-      struct DmmDpu *dpu = _dptr(dpuId, set);
-      if (dpu->Is == RV_DPUIS) {
-        RvDpuRun(&dpu->R, nrTl);
-      } else {
-        UmmDpuRun(&dpu->U, nrTl);
+        uint64_t ht = atomic_load_explicit(&qs[i].HeadTail,
+                                           memory_order_relaxed);
+        size_t left = (uint32_t)(ht >> 32) - (uint32_t)ht;
+        if (most < left) { most = left; victim = i; }
       }
-      dpuId += nrCore;
+      if (most == 0) break;
+      if (_dequeTake(&qs[victim], true, dpuId)) return true;
     }
   }
-#ifdef __DMM_NUMA
-  if (sched_setaffinity(0, sizeof(cpu_set_t), &t0aff) != 0)
-    perror("sched_setaffinity");
+  return false;
+}
+
+// Run DPUs until no worker has any left. Lives on the heap so that an
+// asynchronous launch outlives dpu_launch; its fini frees it.
+struct _launchTask {
+  struct dpu_set_t Set;
+  size_t NrTl;
+  size_t NrThrd; // Host threads per DPU, see nrTlThrd
+  size_t RecAt; // DmmDpuRecords entry to fill when done
+  _dpuDeque Qs[];
+};
+// Returns the host time it took in microseconds
+static double _launchDpu(struct _launchTask *t, size_t dpuId) {
+  double runAt = _wallSec();
+  struct DmmDpu *dpu = _dptr(dpuId, t->Set);
+  if (dpu->Is == RV_DPUIS) {
+    RvDpuRunPar(&dpu->R, t->NrTl, t->NrThrd);
+  } else {
+    UmmDpuRun(&dpu->U, t->NrTl);
+  }
+  dpu->RunUsec = (_wallSec() - runAt) * 1e6;
+  _wmaTouch(dpu);
+  return dpu->RunUsec;
+}
+
+// Interleaved DPUs go _interleaveNrCycle cycles (executed instructions when
+// functional only) at a time
+static void _launchStart(struct _launchTask *t, struct DmmDpu *dpu) {
+  if (dpu->Is == RV_DPUIS)
+    RvDpuStart(&dpu->R, t->NrTl);
+  else
+    UmmDpuStart(&dpu->U, t->NrTl);
+}
+static bool _launchStep(struct _launchTask *t, struct DmmDpu *dpu) {
+#ifdef __DMM_FUNCTIONAL_ONLY
+  if (dpu->Is == RV_DPUIS)
+    return RvDpuStep(&dpu->R, t->NrTl,
+                     dpu->R.Timing.StatNrInstrExec + _interleaveNrCycle);
+  return UmmDpuStep(&dpu->U, t->NrTl,
+                    dpu->U.Timing.StatNrInstrExec + _interleaveNrCycle);
+#else
+  if (dpu->Is == RV_DPUIS)
+    return RvDpuStep(&dpu->R, t->NrTl,
+                     dpu->R.Timing.TotNrCycle + _interleaveNrCycle);
+  return UmmDpuStep(&dpu->U, t->NrTl,
+                    dpu->U.Timing.TotNrCycle + _interleaveNrCycle);
 #endif
+}
+// Threaded code and JIT runs end in one step
+static bool _runsWhole(const struct DmmDpu *dpu) {
+#ifdef __DMM_RV_JIT
+  if (dpu->Is == RV_DPUIS && dpu->R.Program.Jit != NULL)
+    return true;
+#endif
+  return dpu->Is == RV_DPUIS ? dpu->R.Program.Tc != NULL
+                             : dpu->U.Program.Tc != NULL;
+}
+static void _launchPrefetch(struct DmmDpu *dpu) {
+  if (dpu->Is == RV_DPUIS)
+    RvDpuPrefetch(&dpu->R);
+  else
+    UmmDpuPrefetch(&dpu->U);
+}
+
+// Keep up to nrInterleave DPUs in flight and step them in turn, prefetching
+// the next one's state, so that its cache misses overlap the current one's
+// work. Cycle counts are those of running each alone.
+static bool _launchInterleaved(struct _launchTask *t, size_t me) {
+  struct DmmDpu *dpus[_maxNrInterleave];
+  double usec[_maxNrInterleave];
+  size_t nr = 0, dpuId;
+  bool leave = false;
+  for (;;) {
+    while (!leave && nr < nrInterleave &&
+           (_dequeTake(&t->Qs[me], false, &dpuId) ||
+            _steal(t->Qs, me, &dpuId))) {
+      dpus[nr] = _dptr(dpuId, t->Set);
+      usec[nr] = 0;
+      _launchStart(t, dpus[nr++]);
+    }
+    if (nr == 0)
+      return !leave;
+    for (size_t i = 0; i < nr;) {
+      _launchPrefetch(dpus[i + 1 < nr ? i + 1 : 0]);
+      double runAt = _wallSec();
+      bool more = _launchStep(t, dpus[i]);
+      usec[i] += (_wallSec() - runAt) * 1e6;
+      if (more) {
+        ++i;
+        continue;
+      }
+      dpus[i]->RunUsec = usec[i];
+      _wmaTouch(dpus[i]);
+      DmmSimThrdBusyUsec[me] += usec[i];
+      dpus[i] = dpus[--nr];
+      usec[i] = usec[nr];
+    }
+    // Finish the DPUs in flight before leaving
+    leave = leave || _poolYield();
+  }
+}
+
+#ifdef __DMM_SPMD
+// Run riscv DPUs RvSpmdNrLane at a time in lockstep, splitting the host time
+// evenly among them
+static bool _launchSpmd(struct _launchTask *t, size_t me) {
+  struct DmmDpu *dpus[RvSpmdNrLane];
+  RvDpu *lanes[RvSpmdNrLane];
+  for (;;) {
+    size_t nr = 0, dpuId;
+    while (nr < RvSpmdNrLane && (_dequeTake(&t->Qs[me], false, &dpuId) ||
+                                 _steal(t->Qs, me, &dpuId))) {
+      dpus[nr] = _dptr(dpuId, t->Set);
+      lanes[nr] = &dpus[nr]->R;
+      ++nr;
+    }
+    if (nr == 0)
+      return true;
+    double runAt = _wallSec();
+    RvDpuRunSpmd(lanes, nr, t->NrTl);
+    double usec = (_wallSec() - runAt) * 1e6;
+    DmmSimThrdBusyUsec[me] += usec;
+    for (size_t i = 0; i < nr; ++i) {
+      dpus[i]->RunUsec = usec / nr;
+      _wmaTouch(dpus[i]);
+    }
+    if (_poolYield()) return false;
+  }
+}
+#endif
+
+static bool _launchDpus(void *arg, size_t me) {
+  struct _launchTask *t = arg;
+#ifdef __DMM_SPMD
+  if (_dptr(t->Set.begin, t->Set)->Is == RV_DPUIS && t->NrThrd == 1)
+    return _launchSpmd(t, me);
+#endif
+  // DPUs that run whole would leave the others in flight holding their
+  // mailboxes unpolled, so DPU_XFER_PARALLEL to them would wait forever
+  if (nrInterleave > 1 && t->NrThrd == 1 &&
+      !_runsWhole(_dptr(t->Set.begin, t->Set)))
+    return _launchInterleaved(t, me);
+  size_t dpuId;
+  while (_dequeTake(&t->Qs[me], false, &dpuId) || _steal(t->Qs, me, &dpuId)) {
+    DmmSimThrdBusyUsec[me] += _launchDpu(t, dpuId);
+    if (_poolYield()) return false;
+  }
+  return true;
+}
+
+static void _launchFini(void *arg) {
+  struct _launchTask *t = arg;
+  struct dpu_set_t set = t->Set;
 
   // Collect launch timing statistics
   size_t maxCycle = 0, bdExec = 0, bdDma = 0, bdPipe = 0, bdRf = 0;
@@ -241,14 +881,181 @@ dpu_error_t dpu_launch(struct dpu_set_t set, dpu_launch_policy_t _) {
     }
   }
 
-  size_t myRecAt =
-      atomic_fetch_add_explicit(&NrDmmDpuRecord, 1, memory_order_relaxed);
-  DmmLastRecordIdx = myRecAt;
-  struct DmmDpuRecord* myRec = &DmmDpuRecords[myRecAt & 2047];
+  struct DmmDpuRecord* myRec = &DmmDpuRecords[t->RecAt & 2047];
   myRec->Usec = maxCycle / logicFreq;  // logicFreq in MHz, result in microseconds
   myRec->NrDpu = set.end - set.begin; myRec->BdExec = bdExec;
   myRec->BdDma = bdDma; myRec->BdPipe = bdPipe; myRec->BdRf = bdRf;
   atomic_fetch_add_explicit(&DmmTotExecUsec, myRec->Usec, memory_order_relaxed);
+  free(t);
+}
+
+dpu_error_t dpu_launch(struct dpu_set_t set, dpu_launch_policy_t policy) {
+  if (set.dmm_dpu[set.begin].Is == UNINIT_DPUIS)
+    return DPU_ERR_NO_PROGRAM_LOADED;
+  size_t nrTl = DmmMapFetch(set.symbols, "NR_TASKLETS", 11);
+  if (nrTl == MapNoInt) nrTl = 1;
+  struct _launchTask *task = aligned_alloc(_Alignof(struct _launchTask),
+      sizeof(struct _launchTask) + nrCore * sizeof(_dpuDeque));
+  if (task == NULL) return DPU_ERR_SYSTEM;
+  task->Set = set; task->NrTl = nrTl; task->NrThrd = 1;
+  // Expect each DPU to take as long as in the last launch
+  double workUsec = 0;
+  for (size_t i = set.begin; i < set.end; ++i)
+    workUsec += _dptr(i, set)->RunUsec;
+  size_t width = _poolWidth(set.end - set.begin, workUsec);
+#ifdef __DMM_FUNCTIONAL_ONLY
+  // Split DPUs among the cores the set leaves idle
+  size_t nrDpu = set.end - set.begin;
+  if (_dptr(set.begin, set)->Is == RV_DPUIS && nrDpu * 2 <= nrCore &&
+      (workUsec == 0 || workUsec >= nrDpu * _tlThrdMinUsec)) {
+    size_t nrThrd = nrCore / nrDpu;
+    if (nrTlThrd > 0 && nrThrd > nrTlThrd) nrThrd = nrTlThrd;
+    task->NrThrd = nrThrd < nrTl ? nrThrd : nrTl;
+  }
+#endif
+  // Start every worker on the DPUs homed on its core, then balance
+  for (size_t i = 0; i < nrCore; ++i) {
+    size_t first = _firstDpu(set, i);
+    size_t nr = first < set.end ? (set.end - first + nrCore - 1) / nrCore : 0;
+    task->Qs[i].First = first;
+    atomic_init(&task->Qs[i].HeadTail, (uint64_t)nr << 32);
+  }
+  // The record is claimed now so DmmLastRecordIdx is this thread's launch
+  task->RecAt =
+      atomic_fetch_add_explicit(&NrDmmDpuRecord, 1, memory_order_relaxed);
+  DmmLastRecordIdx = task->RecAt;
+  if (width == 1 && policy == DPU_SYNCHRONOUS) {
+    // Not worth a wake-up: run on the calling thread
+    _poolWait(set);
+    for (size_t i = set.begin; i < set.end; ++i)
+      _launchDpu(task, i);
+    _launchFini(task);
+    return DPU_OK;
+  }
+  dpu_error_t ret = _poolSubmit(set, _launchDpus, _launchFini, task, width);
+  if (ret != DPU_OK)
+    free(task);
+  else if (policy == DPU_SYNCHRONOUS)
+    _poolWait(set);
+  return ret;
+}
+
+dpu_error_t dpu_status(struct dpu_set_t set, bool *done, bool *fault) {
+  pthread_mutex_lock(&pool.Mu);
+  bool running = _poolOn(set);
+  pthread_mutex_unlock(&pool.Mu);
+  if (done != NULL) *done = !running;
+  if (fault != NULL) *fault = false;
+  return DPU_OK;
+}
+
+dpu_error_t dpu_sync(struct dpu_set_t set) {
+  _poolWait(set);
+  return DPU_OK;
+}
+
+// Copy between host buffers and DPUs. A non-NULL Src is broadcast to every
+// DPU, else DPU Set.begin + i uses Addrs[i]. A queued transfer keeps its own
+// copy of the prepared buffers in Saved, so the set's can be prepared anew.
+struct _xferTask {
+  struct dpu_set_t Set;
+  DmmSymAddr DAddr;
+  size_t Length;
+  const void *Src;
+  void **Addrs;
+  bool ToDpu;
+  atomic_size_t Next; // See _chunkTake
+  void *Saved[];
+};
+static void _xferDpu(const struct _xferTask *t, size_t dpuId) {
+  void *host = t->Src != NULL ? (void*)t->Src : t->Addrs[dpuId - t->Set.begin];
+  if (host == NULL)
+    return;
+  struct DmmDpu *dpu = _dptr(dpuId, t->Set);
+  uint8_t *dpuWma =
+      dpu->Is == RV_DPUIS ? dpu->R.Program.WMAram : dpu->U.Program.WMAram;
+  if (t->ToDpu)
+    memcpy(&dpuWma[t->DAddr], host, t->Length);
+  else
+    memcpy(host, &dpuWma[t->DAddr], t->Length);
+}
+static bool _xferDpus(void *arg, size_t me) {
+  struct _xferTask *t = arg;
+  for (size_t first, end; _chunkTake(&t->Next, t->Set, &first, &end);) {
+    for (size_t dpuId = first; dpuId < end; ++dpuId)
+      _xferDpu(t, dpuId);
+    if (_poolYield()) return false;
+  }
+  return true;
+}
+
+// Run a transfer now, on the calling thread when too small to share, or
+// queue it when async. Host buffers of a queued transfer must stay valid
+// until it is done.
+enum { _xferBytePerUsec = 4096 }; // memcpy rate of one worker
+static dpu_error_t _xfer(struct _xferTask *t, bool async) {
+  struct dpu_set_t set = t->Set;
+  size_t nrDpu = set.end - set.begin;
+  size_t width = _poolWidth(
+      nrDpu, (double)t->Length * nrDpu / _xferBytePerUsec + 1);
+  atomic_init(&t->Next, set.begin);
+  if (async) {
+    size_t nrSaved = t->Src == NULL ? nrDpu : 0;
+    struct _xferTask *q =
+        malloc(sizeof(struct _xferTask) + nrSaved * sizeof(void*));
+    if (q == NULL) return DPU_ERR_SYSTEM;
+    *q = *t;
+    memcpy(q->Saved, t->Addrs, nrSaved * sizeof(void*));
+    q->Addrs = q->Saved;
+    dpu_error_t ret = _poolSubmit(set, _xferDpus, free, q, width);
+    if (ret != DPU_OK) free(q);
+    return ret;
+  }
+  _poolWait(set);
+  if (width == 1) {
+    for (size_t i = set.begin; i < set.end; ++i)
+      _xferDpu(t, i);
+    return DPU_OK;
+  }
+  return _poolRun(set, _xferDpus, t, width);
+}
+
+// Post a WRAM transfer into the mailbox of every DPU of the set and wait
+// until each is applied, by the DPU if it is running, else by us. Skips the
+// job queue. One post at a time, as a mailbox holds one transfer.
+static dpu_error_t _post(const struct _xferTask *t) {
+  static pthread_mutex_t postMu = PTHREAD_MUTEX_INITIALIZER;
+  struct dpu_set_t set = t->Set;
+  size_t nrDpu = set.end - set.begin;
+  DmmPost *posts = malloc(nrDpu * sizeof(DmmPost));
+  if (posts == NULL) return DPU_ERR_SYSTEM;
+  pthread_mutex_lock(&postMu);
+  for (size_t i = 0; i < nrDpu; ++i) {
+    uint8_t *host = (uint8_t*)(t->Src != NULL ? t->Src : t->Addrs[i]);
+    posts[i] = (DmmPost){host, t->DAddr, t->Length, t->ToDpu, host == NULL};
+    struct DmmDpu *dpu = _dptr(set.begin + i, set);
+    DmmMailbox *mb = dpu->Is == RV_DPUIS ? &dpu->R.Mailbox : &dpu->U.Mailbox;
+    if (host != NULL)
+      __atomic_store_n(&mb->Post, &posts[i], __ATOMIC_RELEASE);
+  }
+  for (size_t nrLeft = nrDpu; nrLeft != 0; _spinPause()) {
+    nrLeft = 0;
+    for (size_t i = 0; i < nrDpu; ++i) {
+      if (__atomic_load_n(&posts[i].Done, __ATOMIC_ACQUIRE))
+        continue;
+      struct DmmDpu *dpu = _dptr(set.begin + i, set);
+      DmmMailbox *mb = dpu->Is == RV_DPUIS ? &dpu->R.Mailbox : &dpu->U.Mailbox;
+      if (!DmmMailboxTake(mb, DmmMailboxHost)) {
+        ++nrLeft;
+        continue;
+      }
+      DmmMailboxApply(mb, dpu->Is == RV_DPUIS ? dpu->R.Program.WMAram :
+                                                dpu->U.Program.WMAram);
+      __atomic_store_n(&mb->Owner, DmmMailboxFree, __ATOMIC_RELEASE);
+    }
+  }
+  pthread_mutex_unlock(&postMu);
+  free(posts);
   return DPU_OK;
 }
 
@@ -263,80 +1070,58 @@ dpu_error_t dpu_prepare_xfer(struct dpu_set_t set, void *hostAddr) {
   return ret;
 }
 
+#ifndef __DMM_NOXFER
+// Estimate the overhead of a transfer into a DmmDpuRecords entry, or only
+// into DmmTotParallelXferUsec for DPU_XFER_PARALLEL
+static void _xferRecord(struct dpu_set_t set, size_t length,
+                        enum DmmXferTy ty, bool parallel) {
+  size_t usec = DmmXferOverhead(set.end - set.begin, set.xfer_addr, length, ty);
+  if (parallel) {
+    atomic_fetch_add_explicit(&DmmTotParallelXferUsec, usec,
+                              memory_order_relaxed);
+    return;
+  }
+  size_t myRecAt =
+      atomic_fetch_add_explicit(&NrDmmDpuRecord, 1, memory_order_relaxed);
+  DmmLastRecordIdx = myRecAt;
+  struct DmmDpuRecord* myRec = &DmmDpuRecords[myRecAt & 2047];
+  myRec->Usec = usec;
+  myRec->NrDpu = set.end - set.begin;
+  myRec->Lt7IfXferTy = ty;
+  atomic_fetch_add_explicit(&DmmTotXferUsec, myRec->Usec, memory_order_relaxed);
+}
+#endif
+
 dpu_error_t
 dpu_push_xfer(struct dpu_set_t set, dpu_xfer_t xfer, const char *symName,
               uint32_t symOff, size_t length, dpu_xfer_flags_t flag) {
   DmmSymAddr dAddr = DmmMapFetch(set.symbols, symName, strlen(symName)) ;
   if (dAddr == MapNoInt) return DPU_ERR_UNKNOWN_SYMBOL;
+  bool parallel = flag & DPU_XFER_PARALLEL;
+  if (parallel && dAddr >= MramBegin) return DPU_ERR_INVALID_MEMORY_TRANSFER;
 #ifndef __DMM_NOXFER
   // Estimate overhead
   enum DmmXferTy ty = 4 * (dAddr < MramBegin) + (xfer & DPU_XFER_FROM_DPU);
   _Static_assert(DPU_XFER_FROM_DPU == 1, "DPU_XFER_FROM_DPU == 1");
-  size_t myRecAt =
-      atomic_fetch_add_explicit(&NrDmmDpuRecord, 1, memory_order_relaxed);
-  DmmLastRecordIdx = myRecAt;
-  struct DmmDpuRecord* myRec = &DmmDpuRecords[myRecAt & 2047];
-  myRec->Usec = DmmXferOverhead(set.end - set.begin, set.xfer_addr, length, ty);
-  myRec->NrDpu = set.end - set.begin;
-  myRec->Lt7IfXferTy = ty;
-  atomic_fetch_add_explicit(&DmmTotXferUsec, myRec->Usec, memory_order_relaxed);
+  _xferRecord(set, length, ty, parallel);
 #endif
   if (dAddr >= MramBeginR)
     dAddr = WramSize + dAddr - MramBeginR;
   dAddr += symOff;
 
-  // Single theaded xfer for small sizes
-  if (length * (set.end - set.begin) <= (1 << 20)) {
-    for (size_t i = set.begin; i < set.end; ++i) {
-      if (set.xfer_addr[i] == NULL)
-        continue;
-      struct DmmDpu *dpu = _dptr(i, set);
-      uint8_t *dpuWma =
-          dpu->Is == RV_DPUIS ? dpu->R.Program.WMAram : dpu->U.Program.WMAram;
-      if (xfer == DPU_XFER_TO_DPU)
-        memcpy(&dpuWma[dAddr], set.xfer_addr[i], length);
-      else
-        memcpy(set.xfer_addr[i], &dpuWma[dAddr], length);
-      if (!(flag & DPU_XFER_NO_RESET))
-        set.xfer_addr[i] = NULL;
-    }
-    return DPU_OK;
-  }
-
-#ifdef __DMM_NUMA
-  cpu_set_t cpuset; CPU_ZERO(&cpuset); CPU_SET(0, &cpuset);
-  if (sched_setaffinity(0, sizeof(cpu_set_t), &cpuset) != 0)
-    perror("sched_setaffinity");
-#endif
-  #pragma omp parallel num_threads(nrCore)
-  {
-    size_t dpuId = omp_get_thread_num();
-    while (dpuId < set.begin)
-      dpuId += nrCore;
-    while (dpuId < set.end) {
-      if (set.xfer_addr[dpuId] != NULL) {
-        struct DmmDpu *dpu = _dptr(dpuId, set);
-      uint8_t *dpuWma =
-          dpu->Is == RV_DPUIS ? dpu->R.Program.WMAram : dpu->U.Program.WMAram;
-        if (xfer == DPU_XFER_TO_DPU)
-          memcpy(&dpuWma[dAddr], set.xfer_addr[dpuId], length);
-        else
-          memcpy(set.xfer_addr[dpuId], &dpuWma[dAddr], length);
-        if (!(flag & DPU_XFER_NO_RESET))
-          set.xfer_addr[dpuId] = NULL;
-      }
-      dpuId += nrCore;
-    }
-  }
-#ifdef __DMM_NUMA
-  if (sched_setaffinity(0, sizeof(cpu_set_t), &t0aff) != 0)
-    perror("sched_setaffinity");
-#endif
-  return DPU_OK;
+  struct _xferTask task = {set, dAddr, length, NULL, &set.xfer_addr[set.begin],
+                           xfer == DPU_XFER_TO_DPU};
+  dpu_error_t ret =
+      parallel ? _post(&task) : _xfer(&task, flag & DPU_XFER_ASYNC);
+  if (!(flag & DPU_XFER_NO_RESET))
+    for (size_t i = set.begin; i < set.end; ++i)
+      set.xfer_addr[i] = NULL;
+  return ret;
 }
 
 dpu_error_t dpu_copy_to(struct dpu_set_t set, const char *symName,
                         uint32_t symOff, const void *src, size_t length) {
+  _poolWait(set);
   struct DmmDpu *dpu = _dptr(set.begin, set);
   DmmSymAddr dAddr = DmmMapFetch(set.symbols, symName, strlen(symName)) ;
   if (dAddr == MapNoInt) return DPU_ERR_UNKNOWN_SYMBOL;
@@ -351,6 +1136,7 @@ dpu_error_t dpu_copy_to(struct dpu_set_t set, const char *symName,
 
 dpu_error_t dpu_copy_from(struct dpu_set_t set, const char *symName,
                           uint32_t symOff, void *dst, size_t length) {
+  _poolWait(set);
   struct DmmDpu *dpu = _dptr(set.begin, set);
   DmmSymAddr dAddr = DmmMapFetch(set.symbols, symName, strlen(symName)) ;
   if (dAddr == MapNoInt) return DPU_ERR_UNKNOWN_SYMBOL;
@@ -369,62 +1155,27 @@ dpu_broadcast_to(struct dpu_set_t set, const char *symName, uint32_t symOff,
   dpu_error_t ret = DPU_OK;
   DmmSymAddr dAddr = DmmMapFetch(set.symbols, symName, strlen(symName)) ;
   if (dAddr == MapNoInt) return DPU_ERR_UNKNOWN_SYMBOL;
+  bool parallel = flags & DPU_XFER_PARALLEL;
+  if (parallel && dAddr >= MramBegin) return DPU_ERR_INVALID_MEMORY_TRANSFER;
 #ifndef __DMM_NOXFER
   // Estimate overhead
   enum DmmXferTy ty = 4 * (dAddr < MramBegin) + 2;
-  size_t myRecAt =
-      atomic_fetch_add_explicit(&NrDmmDpuRecord, 1, memory_order_relaxed);
-  DmmLastRecordIdx = myRecAt;
-  struct DmmDpuRecord* myRec = &DmmDpuRecords[myRecAt & 2047];
-  myRec->Usec = DmmXferOverhead(set.end - set.begin, set.xfer_addr, length, ty);
-  myRec->NrDpu = set.end - set.begin;
-  myRec->Lt7IfXferTy = ty;
-  atomic_fetch_add_explicit(&DmmTotXferUsec, myRec->Usec, memory_order_relaxed);
+  _xferRecord(set, length, ty, parallel);
 #endif
   if (dAddr >= MramBeginR)
     dAddr = WramSize + dAddr - MramBeginR;
   dAddr += symOff;
-  if (length * (set.end - set.begin) <= (1 << 20)) {
-    for (size_t i = set.begin; i < set.end; ++i) {
-      if (set.xfer_addr[i] != NULL)
-        ret = DPU_ERR_TRANSFER_ALREADY_SET;
-      struct DmmDpu *dpu = _dptr(i, set);
-      uint8_t *dpuWma =
-          dpu->Is == RV_DPUIS ? dpu->R.Program.WMAram : dpu->U.Program.WMAram;
-      memcpy(&dpuWma[dAddr], src, length);
-      if (!(flags & DPU_XFER_NO_RESET))
-        set.xfer_addr[i] = NULL;
-    }
-    return ret;
-  }
 
-#ifdef __DMM_NUMA
-  cpu_set_t cpuset; CPU_ZERO(&cpuset); CPU_SET(0, &cpuset);
-  if (sched_setaffinity(0, sizeof(cpu_set_t), &cpuset) != 0)
-    perror("sched_setaffinity");
-#endif
-  #pragma omp parallel num_threads(nrCore)
-  {
-    size_t dpuId = omp_get_thread_num();
-    while (dpuId < set.begin)
-      dpuId += nrCore;
-    while (dpuId < set.end) {
-      if (set.xfer_addr[dpuId] != NULL)
-        ret = DPU_ERR_TRANSFER_ALREADY_SET;
-      struct DmmDpu *dpu = _dptr(dpuId, set);
-      uint8_t *dpuWma =
-          dpu->Is == RV_DPUIS ? dpu->R.Program.WMAram : dpu->U.Program.WMAram;
-      memcpy(&dpuWma[dAddr], src, length);
-      if (!(flags & DPU_XFER_NO_RESET))
-        set.xfer_addr[dpuId] = NULL;
-      dpuId += nrCore;
-    }
+  for (size_t i = set.begin; i < set.end; ++i) {
+    if (set.xfer_addr[i] != NULL)
+      ret = DPU_ERR_TRANSFER_ALREADY_SET;
+    if (!(flags & DPU_XFER_NO_RESET))
+      set.xfer_addr[i] = NULL;
   }
-#ifdef __DMM_NUMA
-  if (sched_setaffinity(0, sizeof(cpu_set_t), &t0aff) != 0)
-    perror("sched_setaffinity");
-#endif
-  return DPU_OK;
+  struct _xferTask task = {set, dAddr, length, src, NULL, true};
+  dpu_error_t xret =
+      parallel ? _post(&task) : _xfer(&task, flags & DPU_XFER_ASYNC);
+  return xret != DPU_OK ? xret : ret;
 }
 
 // `DPU_ERR` prefix is stripped. An "A-" is prepended and hex value is appended.
@@ -466,6 +1217,19 @@ char *dpu_error_to_string(dpu_error_t status) {
 static void __attribute__((constructor)) a() {
   const char* e = getenv("DMM_NR_SIM_THRDS");
   if (e != NULL) nrCore = strtoul(e, NULL, 0);
+  e = getenv("DMM_NR_INTERLEAVE");
+  if (e != NULL) nrInterleave = strtoul(e, NULL, 0);
+#ifdef __DMM_FUNCTIONAL_ONLY
+  e = getenv("DMM_NR_TL_THRDS");
+  if (e != NULL) nrTlThrd = strtoul(e, NULL, 0);
+#endif
+  e = getenv("DMM_MRAM_SPILL_DIR");
+  if (e != NULL) {
+    const char *cap = getenv("DMM_RSS_CAP_MB");
+    DmmWmaSpillInit(e, cap != NULL ? strtoul(cap, NULL, 0) : 0);
+  }
+  e = getenv("DMM_PRG_CACHE_DIR");
+  if (e != NULL) DmmPrgCacheInit(e);
   e = getenv("DMM_LogicFrequency");
   if (e != NULL) logicFreq = strtoul(e, NULL, 0);
   e = getenv("DMM_MemoryFrequency");
@@ -475,7 +1239,9 @@ static void __attribute__((constructor)) a() {
   if (e != NULL) dumpFile = strdup(e);
 #endif
 
-  if (nrCore <= 0 || nrCore > 512) nrCore = sysconf(_SC_NPROCESSORS_ONLN);
+  if (nrCore <= 0 || nrCore > DmmMaxNrSimThrd) nrCore = sysconf(_SC_NPROCESSORS_ONLN);
+  if (nrInterleave <= 0) nrInterleave = 1;
+  if (nrInterleave > _maxNrInterleave) nrInterleave = _maxNrInterleave;
   if (logicFreq <= 0) logicFreq = 350;
   if (memFreq <= 0) memFreq = 2400;
 
@@ -484,20 +1250,7 @@ static void __attribute__((constructor)) a() {
     dmmDpuSize += 4096;
 
 #ifdef __DMM_NUMA
-  if (sched_getaffinity(0, sizeof(cpu_set_t), &t0aff) != 0)
-    fputs("sched_getaffinity thread 0 failed\n", stderr);
-// Set thread affinity once at startup - threads will be bound to cores matching
-// their ID. Skip t0 (main thread) to avoid restricting other parts of the app
-#pragma omp parallel num_threads(nrCore)
-  {
-    size_t dpuId = omp_get_thread_num();
-    cpu_set_t cpuset; CPU_ZERO(&cpuset); CPU_SET(dpuId, &cpuset);
-    if (sched_setaffinity(0, sizeof(cpu_set_t), &cpuset) != 0)
-        perror("sched_setaffinity");
-  }
-  // Somehow, set and reset affinity ot t0 here makes prim programs 4% faster
-  // overall compared to an `if (dpuId != 0)` above. Don't know why.
-  if (sched_setaffinity(0, sizeof(cpu_set_t), &t0aff) != 0)
-    perror("sched_setaffinity");
+  for (size_t i = 0; i < nrCore; ++i)
+    coreNode[i] = numa_node_of_cpu(i);
 #endif
 }
@@ -2,39 +2,58 @@
 set -xe
 cd "$(dirname "$0")"
 
+# hostBuild DIR [CMAKE_OPTION...] builds only the host apps, which then run the
+# DPU programs of build/
+hostBuild() {
+  rm -r "$1" || true
+  cmake -GNinja -DCMAKE_EXPORT_COMPILE_COMMANDS=ON -DCMAKE_BUILD_TYPE=Release \
+    -S. "-B$1" "-DCMAKE_C_COMPILER=$CC" -DDMM_UPMEM=OFF -DDMM_RV=OFF "${@:2}"
+  ninja -C "$1" all
+}
+
 if test -n "$1"; then
   rm -r build || true
   mkdir -p build
   cmake -GNinja -DCMAKE_EXPORT_COMPILE_COMMANDS=ON -DCMAKE_BUILD_TYPE=Release \
     -S. -Bbuild -DCMAKE_C_COMPILER="$1/bin/clang" -DDMM_UPMEM=ON -DDMM_RV=OFF
   ninja -C build all dpuExamples
+  CC="$1/bin/clang"
+  # Functional only, runs the threaded code instead of the timing model
+  hostBuild build-func -DDMM_FUNCTIONAL_ONLY=ON
   # use libomp from this llvm installation
   export LD_LIBRARY_PATH="$1/lib/x86_64-pc-linux-gnu:${LD_LIBRARY_PATH}"
 fi
 
-time build/dmmBS 5242880 640 build/devApp/objdumps/BS.objdump
-time build/dmmCOMPACT 15728640 2560 build/devApp/objdumps/COMPACT.objdump
-time build/dmmHST 31457280 1280 build/devApp/objdumps/HST.objdump
-time build/dmmGEMV 10240 2048 build/devApp/objdumps/GEMV.objdump
-time build/dmmMLP 1024 1024 build/devApp/objdumps/MLP.objdump
-time build/dmmNW 2000 1000 64 build/devApp/objdumps/NW.objdump
-time build/dmmOPDEMO 262144 512 build/devApp/objdumps/OPDEMO.objdump 3
-time build/dmmOPDEMOF 262144 512 build/devApp/objdumps/OPDEMOF.objdump 4
-time build/dmmRED 96000000 1600 build/devApp/objdumps/RED.objdump
-time build/dmmSCAN 96000000 1600 build/devApp/objdumps/SCAN.objdump
-time build/dmmSPMV 44444 888 build/devApp/objdumps/SPMV.objdump
-time build/dmmTRNS 2000 200 build/devApp/objdumps/TRNS.objdump
-time build/dmmTS 655360 640 build/devApp/objdumps/TS.objdump
-time build/dmmUNI 100000 512 build/devApp/objdumps/UNI.objdump
-time build/dmmVA 15728640 2560 build/devApp/objdumps/VA.objdump
-
 if ! [ -f hostApp/BFS/csr.txt ]; then
   wget -O hostApp/BFS/csr.txt.zst \
     "https://drive.usercontent.google.com/download?id=1bXYWq_4dXrJcst5jsLL3CJTeZTQCrBlr&export=download"
   zstd -d hostApp/BFS/csr.txt.zst
 fi
-time build/dmmBFS simpleBFSDpu 0 hostApp/BFS/csr.txt /tmp/dmmBfsDOut build/devApp/objdumps/BFS.objdump 192 
 build/dmmBFS simpleBFSCpu 0 hostApp/BFS/csr.txt /tmp/dmmBfsCOut >/dev/null
-# Check the output is indeed correct here.
-diff /tmp/dmmBfs{C,D}Out
+
+# ummApps DIR runs the host apps built in DIR
+ummApps() {
+  time $1/dmmBS 5242880 640 build/devApp/objdumps/BS.objdump
+  time $1/dmmCOMPACT 15728640 2560 build/devApp/objdumps/COMPACT.objdump
+  time $1/dmmHST 31457280 1280 build/devApp/objdumps/HST.objdump
+  time $1/dmmGEMV 10240 2048 build/devApp/objdumps/GEMV.objdump
+  time $1/dmmMLP 1024 1024 build/devApp/objdumps/MLP.objdump
+  time $1/dmmNW 2000 1000 64 build/devApp/objdumps/NW.objdump
+  time $1/dmmOPDEMO 262144 512 build/devApp/objdumps/OPDEMO.objdump 3
+  time $1/dmmOPDEMOF 262144 512 build/devApp/objdumps/OPDEMOF.objdump 4
+  time $1/dmmRED 96000000 1600 build/devApp/objdumps/RED.objdump
+  time $1/dmmSCAN 96000000 1600 build/devApp/objdumps/SCAN.objdump
+  time $1/dmmSPMV 44444 888 build/devApp/objdumps/SPMV.objdump
+  time $1/dmmTRNS 2000 200 build/devApp/objdumps/TRNS.objdump
+  time $1/dmmTS 655360 640 build/devApp/objdumps/TS.objdump
+  time $1/dmmUNI 100000 512 build/devApp/objdumps/UNI.objdump
+  time $1/dmmVA 15728640 2560 build/devApp/objdumps/VA.objdump
+  time $1/dmmASYNC 65536 512 build/devApp/objdumps/ASYNC.objdump
+  time $1/dmmBFS simpleBFSDpu 0 hostApp/BFS/csr.txt /tmp/dmmBfsDOut \
+    build/devApp/objdumps/BFS.objdump 192
+  # Check the output is indeed correct here.
+  diff /tmp/dmmBfs{C,D}Out
+}
+ummApps build
+ummApps build-func
 rm /tmp/dmmBfs{C,D}Out
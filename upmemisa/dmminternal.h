@@ -21,7 +21,8 @@ enum {
   NullReg = NumGpRegisters + 8,
   ZeroImm = 0,
   badReg  = 99,
-  badImm  = MapNoInt
+  badImm  = MapNoInt,
+  badOpcode = 0xff
 };
 
 // --- Enums for conditions and opcodes ---
@@ -31,7 +32,7 @@ typedef enum {
   GTU, LTS, GES, LES, GTS, EQ, NEQ, XZ, NXZ, XLEU, XGTU, XLES, XGTS,
   SE, SO, NSH32, SH32, MAX, NMAX, SMALL, LARGE,
   NrConds,
-  badCond = 0xdead
+  badCond = 0xff
 } UmmCc;
 
 typedef enum {
@@ -82,25 +83,52 @@ extern const char *UmmOpStr[NrOpcode], *UmmOpStr[NrOpcode], *UmmCcStr[NrConds];
 extern DmmMap UmmStrToOpcode, UmmStrToCc, UmmStrToJcc;
 
 // --- Instruction Struct ---
+// Per-instruction flags, precomputed at load so the timing model need not
+// classify opcodes on every issue
+enum {
+  UmmIfSextA   = 1, // ImmA is sign extended to 64 bits (sub forms)
+  UmmIfDma     = 2, // ldma, ldmai, sdma
+  UmmIfRdPairB = 4, // reads the RegB pair
+  UmmIfWrPair  = 8, // writes the RegC pair
+};
 typedef struct UmmInstr {
-  UmmOpcode Opcode;
-  UmmCc Cond;
-  size_t RegA, RegB, RegC;
-  size_t ImmA, ImmB;
+  uint8_t Opcode; // UmmOpcode
+  uint8_t Cond;   // UmmCc
+  uint8_t RegA, RegB, RegC;
+  uint8_t Flags;
+  uint32_t ImmA, ImmB;
 } UmmInstr;
+_Static_assert(sizeof(UmmInstr) == 16, "UmmInstr should stay packed");
+static inline uint64_t UmmImmA(const UmmInstr *i) {
+  return i->Flags & UmmIfSextA ? (uint64_t)(int64_t)(int32_t)i->ImmA : i->ImmA;
+}
+
+// --- Threaded-code instruction (functional-only fast path) ---
+typedef struct UmmTcInstr {
+  // Labels in UmmDpuRunTc: operation, writeback, condition, then next instr
+  const void *Op, *Wb, *Cc, *Fin;
+  uint64_t ImmA, ImmB; // ImmB is an IRAM index for jumps
+  uint8_t RegA, RegB, RegC;
+  uint8_t CcArg; // result compared against by max/nmax
+} UmmTcInstr;
 
 // --- Program Struct and Member Functions ---
 typedef struct UmmPrg {
   uint8_t* WMAram;
-  UmmInstr* Iram;
+  UmmInstr* Iram; // Shared by all DPUs of a load on a NUMA node, not owned
+  const UmmTcInstr* Tc; // Threaded code shared by all DPUs of a load, or NULL
 } UmmPrg;
 enum {
-  _WMAINrByte = WramSize + MramSize + AtomicSize + IramNrInstr * sizeof(UmmInstr),
+  _WMAINrByte = WramSize + MramSize + AtomicSize,
   WMAINrPage = (_WMAINrByte + 4095) / 4096,
-  WMAINrByte = WMAINrPage * 4096
+  WMAINrByte = WMAINrPage * 4096,
+  UmmIramNrByte = IramNrInstr * sizeof(UmmInstr)
 };
 void UmmPrgInit(UmmPrg* p, int numaNode);
 void UmmPrgFini(UmmPrg* p);
+// Allocate a zeroed IRAM on numaNode (any node if negative) and free it
+UmmInstr* UmmIramAlloc(int numaNode);
+void UmmIramFree(UmmInstr* iram);
 size_t UmmPrgLoadBinary(UmmPrg *p, const char *filename, DmmMap symbols,
                          bool paged[WMAINrPage]);
 
@@ -153,6 +181,8 @@ typedef struct Timing {
   // track whether each tasklet is ready to execute
   long lastIssue;
   long lastRunAt[MaxNumTasklets];
+  uint32_t runMask, blockMask; // By State, see UmmTletSetState
+  DmmRevolver revolver;         // Slots of lastRunAt still in the window
 #ifdef __DMM_TSCDUMP
   // track each instructions' tsc (cycles each instruction takes)
   size_t lastPc[MaxNumTasklets];
@@ -166,15 +196,35 @@ UmmTlet* UmmTimingCycle(UmmTiming *t, size_t nrTasklets);
 static inline void UmmTimingFini(UmmTiming* t) {
   DmmMramTimingFini(&t->MramTiming);
 }
+// Set a tasklet's State and keep the issue masks in step
+static inline void UmmTletSetState(UmmTiming* t, size_t id, UmmTletState s) {
+  uint32_t bit = 1u << id;
+  t->Threads[id].State = s;
+  t->runMask = (t->runMask & ~bit) | (s == RUNNABLE ? bit : 0);
+  t->blockMask = (t->blockMask & ~bit) | (s == BLOCK ? bit : 0);
+}
 
 // --- DMM Simulated DPU Interface ---
 typedef struct UmmDpu {
   UmmPrg Program;
   UmmTiming Timing;
+  DmmMailbox Mailbox;
 } UmmDpu;
 void UmmDpuInit(UmmDpu* d, size_t memFreq, size_t logicFreq, int numaNode);
 void UmmDpuRun(UmmDpu* d, size_t nrTasklets);
+// UmmDpuRun in pieces, so that one thread can interleave several DPUs: start,
+// then step until it returns false. A step stops at the first cycle (executed
+// instruction when functional only) at or past stopAt, or runs threaded code
+// to the end.
+void UmmDpuStart(UmmDpu* d, size_t nrTasklets);
+bool UmmDpuStep(UmmDpu* d, size_t nrTasklets, long stopAt);
+// Bring the state a step starts with into cache
+void UmmDpuPrefetch(const UmmDpu* d);
 void UmmDpuExecuteInstr(UmmDpu* d, UmmTlet* thread);
+// Translate an IRAM into threaded code (IramNrInstr + 1 entries, free()'d by
+// the caller) and run it. Functional-only: no timing is modeled.
+UmmTcInstr* UmmTcBuild(const UmmInstr* iram);
+void UmmDpuRunTc(UmmDpu* d, size_t nrTasklets);
 static inline void UmmDpuFini(UmmDpu* d) {
   UmmPrgFini(&d->Program);
   UmmTimingFini(&d->Timing);
@@ -186,11 +236,12 @@ typedef struct {
     uint32_t Addr;
     uint32_t Dat[4];
 } ObjdLnToDatRet;
+// Lines need not be NUL-terminated, but the text must be somewhere after them.
 // ObjdLnToSym tries parsing an objdump line of size sz into a data structure.
 ObjdLnToDatRet ObjdLnToDat(const char* objdumpLine, size_t sz);
-// ObjdLnToSym tries parsing an objdump line of size *outBufSz into a (symbol
-// name, SymbAddr) pair. SymbAddr is returned, and symbol name is saved into
-// outBuf. If the line does not match, it sets *outBufSz to 0.
-DmmSymAddr ObjdLnToSym(const char *objdumpLine, size_t linesz, char *outBuf,
-                       size_t* outBufSz);
+// ObjdLnToSym tries parsing an objdump line into a (symbol name, SymbAddr)
+// pair. SymbAddr is returned, and *name points to the symbol name within the
+// line. If the line does not match, it sets *nameSz to 0.
+DmmSymAddr ObjdLnToSym(const char *objdumpLine, size_t linesz,
+                       const char **name, size_t *nameSz);
 #endif
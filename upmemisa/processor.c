@@ -1,5 +1,6 @@
 #include "dmminternal.h"
 #include <assert.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 
@@ -34,16 +35,30 @@ void UmmTletInit(UmmTlet* thread, uint8_t i) {
 void UmmDpuInit(UmmDpu* d, size_t memFreq, size_t logicFreq, int numaNode) {
   UmmPrgInit(&d->Program, numaNode);
   UmmTimingInit(&d->Timing, d->Program.Iram, memFreq, logicFreq);
+  memset(&d->Mailbox, 0, sizeof(DmmMailbox));
 }
 
-void UmmDpuRun(UmmDpu* d, size_t nrTasklets) {
+void UmmDpuStart(UmmDpu* d, size_t nrTasklets) {
   for (size_t i = 0; i < nrTasklets; ++i)
     d->Timing.Threads[i].Pc = 0;
-  d->Timing.Threads[0].State = RUNNABLE;
-  bool running = true;
-  while (running) {
+  UmmTletSetState(&d->Timing, 0, RUNNABLE);
 #ifdef __DMM_FUNCTIONAL_ONLY
-    running = false;
+  DmmMailboxOpen(&d->Mailbox, d->Program.WMAram, d->Timing.StatNrInstrExec);
+#else
+  DmmMailboxOpen(&d->Mailbox, d->Program.WMAram, d->Timing.TotNrCycle);
+#endif
+}
+
+bool UmmDpuStep(UmmDpu* d, size_t nrTasklets, long stopAt) {
+  uint8_t *wma = d->Program.WMAram;
+#ifdef __DMM_FUNCTIONAL_ONLY
+  if (d->Program.Tc != NULL) {
+    UmmDpuRunTc(d, nrTasklets);
+    DmmMailboxClose(&d->Mailbox, wma);
+    return false;
+  }
+  while (d->Timing.StatNrInstrExec < stopAt) {
+    bool running = false;
     for (size_t i = 0; i < nrTasklets; ++i) {
       if (d->Timing.Threads[i].State != RUNNABLE)
         continue;
@@ -51,19 +66,37 @@ void UmmDpuRun(UmmDpu* d, size_t nrTasklets) {
       UmmDpuExecuteInstr(d, &d->Timing.Threads[i]);
       ++d->Timing.StatNrInstrExec;
     }
+    DmmMailboxPoll(&d->Mailbox, wma, d->Timing.StatNrInstrExec);
 #else
+  while (d->Timing.TotNrCycle < stopAt) {
     UmmTlet *thrd = UmmTimingCycle(&d->Timing, nrTasklets);
     if (thrd != NULL)
       UmmDpuExecuteInstr(d, thrd);
-    running = false;
-    for (size_t i = 0; i < nrTasklets; ++i) {
-      if (d->Timing.Threads[i].State == SLEEP)
-        continue;
-      running = true;
-      break;
-    }
+    bool running = (d->Timing.runMask | d->Timing.blockMask) &
+                   ((1u << nrTasklets) - 1);
+    DmmMailboxPoll(&d->Mailbox, wma, d->Timing.TotNrCycle);
 #endif
+    if (!running) {
+      DmmMailboxClose(&d->Mailbox, wma);
+      return false;
+    }
   }
+  return true;
+}
+
+void UmmDpuRun(UmmDpu* d, size_t nrTasklets) {
+  UmmDpuStart(d, nrTasklets);
+  while (UmmDpuStep(d, nrTasklets, LONG_MAX))
+    ;
+}
+
+void UmmDpuPrefetch(const UmmDpu* d) {
+  const char *t = (const char*)&d->Timing;
+  for (size_t i = 0; i < offsetof(UmmTiming, revolver) + sizeof(DmmRevolver);
+       i += 64)
+    __builtin_prefetch(t + i, 1);
+  __builtin_prefetch(d->Timing.MramTiming.ScheRob.data, 1);
+  __builtin_prefetch(d->Timing.MramTiming.ScheReadyQ.data, 1);
 }
 
 void UmmDpuExecuteInstr(UmmDpu* d, UmmTlet* thread) {
@@ -73,7 +106,7 @@ void UmmDpuExecuteInstr(UmmDpu* d, UmmTlet* thread) {
   size_t rc = instr->RegC;
   uint8_t *wma = d->Program.WMAram;
   uint64_t va = thread->Regs[instr->RegA], vb = thread->Regs[instr->RegB],
-           immA = instr->ImmA, result = 0;
+           immA = UmmImmA(instr), result = 0;
 
   switch (instr->Opcode) {
   case LDMA: {
@@ -208,13 +241,13 @@ void UmmDpuExecuteInstr(UmmDpu* d, UmmTlet* thread) {
     result = wma[WramSize + MramSize + va];
     wma[WramSize + MramSize + va] = instr->Opcode == ACQUIRE;
     break;
-  case STOP: thread->State = SLEEP; break;
+  case STOP: UmmTletSetState(&d->Timing, thread->Id, SLEEP); break;
   case BOOT: case RESUME:
     va = va + immA;
     va = (va ^ (va >> 8)) & 31;
     result = d->Timing.Threads[va].State != SLEEP;
     if (result) break;
-    d->Timing.Threads[va].State = RUNNABLE;
+    UmmTletSetState(&d->Timing, va, RUNNABLE);
     if (instr->Opcode == BOOT)
       d->Timing.Threads[va].Pc = 0;
     break;
@@ -1,159 +1,257 @@
-#define PCRE2_CODE_UNIT_WIDTH 8
 #include "dmminternal.h"
 #include <assert.h>
 #include <byteswap.h>
-#include <pcre2.h>
+#include <fcntl.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #ifdef __DMM_NUMA
 #include <numa.h>
 #include <numaif.h>
 #endif
 
-// Regex compiled patterns
-static pcre2_code *instrRe, *symRe, *dataRe;
-static pcre2_match_data *instrMat, *symMat, *dataMat;
-static void __attribute__((constructor)) regex_init() {
-  int errcode;
-  PCRE2_SIZE erroffset;
-  instrRe = pcre2_compile(
-      (PCRE2_SPTR) "^[0-9a-f]{8}: (?:[0-9a-f]{2} ){8} {5}\\t([\\w.]+) "
-                   "?([\\w-]+)?,? ?([\\w-]+)?,? ?([\\w-]+)?,? ?([\\w-]+)?,? "
-                   "?([\\w-]+)?,? ?([\\w-]+)?",
-      PCRE2_ZERO_TERMINATED, 0, &errcode, &erroffset, NULL);
-  symRe = pcre2_compile(
-      (PCRE2_SPTR) "^([0-9a-f]{8}) [lg] +[dfFO]* \\S+\\t[0-9a-f]{8} (\\S+)$",
-      PCRE2_ZERO_TERMINATED, 0, &errcode, &erroffset, NULL);
-  dataRe = pcre2_compile((PCRE2_SPTR)
-      "^ ([0-9a-f]+) ([0-9a-f]{8}) ([0-9a-f]{8})? "
-      "([0-9a-f]{8})? ([0-9a-f]{8})?  +.{8,}$",
-      PCRE2_ZERO_TERMINATED, 0, &errcode, &erroffset, NULL);
-  if (!instrRe || !symRe || !dataRe)
-    exit(fprintf(stderr, "Failed to compile regex\n"));
-  instrMat = pcre2_match_data_create_from_pattern(instrRe, NULL);
-  symMat = pcre2_match_data_create_from_pattern(symRe, NULL);
-  dataMat = pcre2_match_data_create_from_pattern(dataRe, NULL);
+void UmmPrgInit(UmmPrg* p, int numaNode) {
+  p->WMAram = DmmWmaAlloc(WMAINrByte, numaNode);
+  p->Iram = NULL;
+  p->Tc = NULL;
+}
+void UmmPrgFini(UmmPrg* p) {
+  DmmWmaFree(p->WMAram, WMAINrByte);
+  p->WMAram = NULL;
 }
 
-void UmmPrgInit(UmmPrg* p, int numaNode) {
-  p->WMAram = mmap(NULL, WMAINrByte, PROT_READ | PROT_WRITE,
-                   MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
-  if (p->WMAram == MAP_FAILED) {
+UmmInstr* UmmIramAlloc(int numaNode) {
+  void *iram = mmap(NULL, UmmIramNrByte, PROT_READ | PROT_WRITE,
+                    MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+  if (iram == MAP_FAILED) {
     perror("mmap");
     exit(EXIT_FAILURE);
   }
-  p->Iram = (UmmInstr*)(p->WMAram + WramSize + MramSize + AtomicSize);
-
-  if (madvise(p->WMAram, WMAINrByte, MADV_HUGEPAGE) != 0)
-    perror("madvise");
 #ifdef __DMM_NUMA
-  // Bind WMAram to specified NUMA node
   if (numaNode >= 0) {
     struct bitmask *mask = numa_allocate_nodemask();
     numa_bitmask_setbit(mask, numaNode);
-    long ret = mbind(p->WMAram, WMAINrByte, MPOL_BIND,
+    long ret = mbind(iram, UmmIramNrByte, MPOL_BIND,
                      mask->maskp, mask->size + 1, MPOL_MF_MOVE | MPOL_MF_STRICT);
     if (ret != 0)
-      perror("mbind UmmPrg WMAram");
+      perror("mbind UmmPrg Iram");
     numa_free_nodemask(mask);
   }
 #endif
+  return iram;
 }
-void UmmPrgFini(UmmPrg* p) {
-  if (p->WMAram != NULL)
-    munmap(p->WMAram, WMAINrByte);
+void UmmIramFree(UmmInstr* iram) {
+  munmap(iram, UmmIramNrByte);
 }
 
 // -- OBJDUMP parsing related functions --
 // helpers for instruction parsing
-static uint32_t parseImmediate(const char *imm, PCRE2_SIZE sz,
+static uint32_t parseImmediate(const char *imm, size_t sz,
                                DmmMap symbols);
-static uint8_t parseRegister(const char* reg, PCRE2_SIZE sz);
-static UmmInstr stores(const char* fields, const PCRE2_SIZE *ovector,
+static uint8_t parseRegister(const char* reg, size_t sz);
+static uint8_t parseOpcode(const char* opcode, size_t sz);
+static UmmInstr stores(const char* fields, const size_t *ovector,
                        size_t nrFields, DmmMap symbols);
-static UmmInstr subs(const char* fields, const PCRE2_SIZE *ovector,
+static UmmInstr subs(const char* fields, const size_t *ovector,
                        size_t nrFields, DmmMap symbols);
-static UmmInstr jumps(const char* fields, const PCRE2_SIZE *ovector,
+static UmmInstr jumps(const char* fields, const size_t *ovector,
                       size_t nrFields, DmmMap symbols);
-static UmmInstr allothers(const char* fields, const PCRE2_SIZE *ovector,
+static UmmInstr allothers(const char* fields, const size_t *ovector,
                           size_t nrFields, DmmMap symbols);
 
-// ObjdLnToInstr turns an objdump line into an Instr struct.
+// Character classes of the objdump line formats, as \w, \s and [0-9a-f]
+static inline bool isWord(char c) {
+  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+         (c >= '0' && c <= '9') || c == '_';
+}
+static inline bool isSpace(char c) {
+  return c == ' ' || (c >= '\t' && c <= '\r');
+}
+static inline bool isHex(char c) {
+  return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f');
+}
+static inline bool isHexRun(const char *s, size_t n) {
+  for (size_t i = 0; i < n; ++i)
+    if (!isHex(s[i])) return false;
+  return true;
+}
+// 0x10 | value of [0-9a-f], 0 for other characters
+static const uint8_t hexDigit[256] = {
+  ['0'] = 0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19,
+  ['a'] = 0x1a, 0x1b, 0x1c, 0x1d, 0x1e, 0x1f,
+};
+// Value of 8 hex digits at s into *v, false if they are not all hex
+static inline bool hex8(const char *s, uint32_t *v) {
+  uint32_t val = 0, bad = 0;
+  for (size_t i = 0; i < 8; ++i) {
+    uint32_t d = hexDigit[(uint8_t)s[i]];
+    val = val << 4 | (d & 0xf);
+    bad |= ~d;
+  }
+  *v = val;
+  return !(bad & 0x10);
+}
+// Whether at is the end of the line, maybe before its newline
+static inline bool isEnd(const char *line, size_t sz, size_t at) {
+  return at == sz || (at + 1 == sz && line[at] == '\n');
+}
+
+// ObjdLnToInstr turns an objdump line into an Instr struct. Lines look like
+//   "0000a0c8: 00 00 00 00 00 00 00 00     \tlsl_add r0, r1, r2, 3"
+// and up to 6 operands are split off at [\w-]+ runs with ", " between.
 UmmInstr ObjdLnToInstr(const char* objdumpLine, size_t sz, DmmMap symbols) {
-  int rc = pcre2_match(instrRe, (PCRE2_SPTR)objdumpLine, sz, 0, 0, instrMat, NULL);
-  if (rc < 2)
-    return (UmmInstr){.Opcode = MapNoInt};
-  PCRE2_SIZE* ovector = pcre2_get_ovector_pointer(instrMat) + 2, ov0 = ovector[0];
-  if (objdumpLine[ov0] == 'j') {
-    return jumps(objdumpLine, ovector, rc-1, symbols);
-  } else if (objdumpLine[ov0] == 's') {
-    if (ovector[1] - ov0 == 2)
-      return stores(objdumpLine, ovector, rc-1, symbols);
-    else if (objdumpLine[ov0 + 1] == 'u')
-      return subs(objdumpLine, ovector, rc-1, symbols);
+  const char *l = objdumpLine;
+  enum { opAt = 8 + 2 + 8 * 3 + 5 + 1, maxNrField = 7 };
+  if (sz <= opAt || !isHexRun(l, 8) || l[8] != ':' || l[9] != ' ' ||
+      l[opAt - 1] != '\t')
+    return (UmmInstr){.Opcode = badOpcode};
+  for (size_t i = 10; i < 10 + 8 * 3; i += 3)
+    if (!isHex(l[i]) || !isHex(l[i + 1]) || l[i + 2] != ' ')
+      return (UmmInstr){.Opcode = badOpcode};
+  for (size_t i = 10 + 8 * 3; i < opAt - 1; ++i)
+    if (l[i] != ' ')
+      return (UmmInstr){.Opcode = badOpcode};
+
+  // Field n spans [ovector[2n], ovector[2n+1]); 0 is the opcode
+  size_t ovector[2 * maxNrField], at = opAt, end = at, nrFields = 1;
+  while (end < sz && (isWord(l[end]) || l[end] == '.'))
+    ++end;
+  if (end == at)
+    return (UmmInstr){.Opcode = badOpcode};
+  ovector[0] = at; ovector[1] = at = end;
+  if (at < sz && l[at] == ' ') ++at;
+  for (size_t n = 1; n < maxNrField; ++n) {
+    for (end = at; end < sz && (isWord(l[end]) || l[end] == '-'); ++end);
+    ovector[2 * n] = at; ovector[2 * n + 1] = end; // Empty if absent
+    if (end != at)
+      nrFields = n + 1;
+    at = end;
+    if (at < sz && l[at] == ',') ++at;
+    if (at < sz && l[at] == ' ') ++at;
   }
-  return allothers(objdumpLine, ovector, rc-1, symbols);
+  size_t ov0 = ovector[0];
+  UmmInstr instr;
+  if (objdumpLine[ov0] == 'j')
+    instr = jumps(objdumpLine, ovector, nrFields, symbols);
+  else if (objdumpLine[ov0] == 's' && ovector[1] - ov0 == 2)
+    instr = stores(objdumpLine, ovector, nrFields, symbols);
+  else if (objdumpLine[ov0] == 's' && objdumpLine[ov0 + 1] == 'u')
+    instr = subs(objdumpLine, ovector, nrFields, symbols);
+  else
+    instr = allothers(objdumpLine, ovector, nrFields, symbols);
+
+  // Classify the opcode for the timing model
+  UmmOpcode op = instr.Opcode;
+  _Static_assert(SDMA == 2 && LDMAI == 1 && LDMA == 0, "Please dude");
+  _Static_assert(LD + 1 == SOpcodeStart, "please dude");
+  if (instr.Opcode == badOpcode)
+    return instr;
+  if (op <= SDMA)
+    instr.Flags |= UmmIfDma;
+  if (op == DIV_STEP || op == MUL_STEP || op == SD || op == MOVD || op == SWAPD)
+    instr.Flags |= UmmIfRdPairB;
+  if (op >= LD)
+    instr.Flags |= UmmIfWrPair;
+  return instr;
 }
 
+// Data lines: " addr word word word word  ascii", as printed by `objdump -s`.
+// Rows of fewer words keep their padding; the ascii part is 8 characters or
+// more.
 ObjdLnToDatRet ObjdLnToDat(const char* objdumpLine, size_t sz) {
   ObjdLnToDatRet ret = {.NrDat=0};
-  int rc = pcre2_match(dataRe, (PCRE2_SPTR)objdumpLine, sz, 0, 0, dataMat, NULL);
-  if (rc <= 0)
-    return ret;  // No match, NrDat remains 0
-  PCRE2_SIZE* ovector = pcre2_get_ovector_pointer(dataMat);
-  char buf[9] = {[8] = '\0'}; // hold hex substrings (max 8 chars + null)
-  ret.NrDat = rc - 2;  // Ignore full match + first group (address)
-
-  for (uint32_t i = 0; i < ret.NrDat; i++) {
-    // Group 2, 3, 4, 5
-    size_t start = ovector[(i+2)*2];
-    strncpy(buf, objdumpLine + start, 8);
-    ret.Dat[i] = bswap_32((uint32_t)strtoul(buf, NULL, 16));
+  const char *l = objdumpLine;
+  size_t at = 1;
+  if (sz == 0 || l[0] != ' ')
+    return ret;
+  uint32_t addr = 0, dat[4] = {}, nrDat = 0, word;
+  while (at < sz && isHex(l[at]))
+    addr = addr << 4 | hexDigit[(uint8_t)l[at++]];
+  if (at == 1 || at >= sz || l[at++] != ' ')
+    return ret;
+  // The first word is required, the others each follow a space
+  for (size_t i = 0; i < 4; ++i) {
+    if (i != 0 && (at >= sz || l[at++] != ' '))
+      return ret;
+    if (sz - at >= 8 && hex8(l + at, &word)) {
+      dat[i] = bswap_32(word);
+      nrDat = i + 1;
+      at += 8;
+    } else if (i == 0) {
+      return ret;
+    }
   }
-  // Address (first group)
-  ret.Addr = (uint32_t)strtoul(objdumpLine + ovector[2], NULL, 16);
+  // Then two spaces or more and the ascii dump
+  size_t asciiEnd = l[sz - 1] == '\n' ? sz - 1 : sz;
+  if (asciiEnd < at + 2 + 8 || l[at] != ' ' || l[at + 1] != ' ' ||
+      memchr(l + at + 2, '\n', asciiEnd - at - 2) != NULL)
+    return ret;
+  ret.NrDat = nrDat;
+  memcpy(ret.Dat, dat, sizeof(dat));
+  ret.Addr = addr;
   return ret;
 }
 
-// ObjdLnToSym tries parsing an objdump line of size *outBufSz into a (symbol
-// name, SymbAddr) pair. SymbAddr is returned, and symbol name is saved into
-// outBuf. If the line does not match, it sets *outBufSz to 0.
-DmmSymAddr ObjdLnToSym(const char *objdumpLine, size_t linesz, char *outBuf,
-                       size_t* outBufSz) {
-  int rc = pcre2_match(symRe, (PCRE2_SPTR)objdumpLine, linesz, 0, 0, symMat, NULL);
-  if (rc != 3) { // We expect exactly 3 matches (full, addr, name)
-    *outBufSz = 0;
-    return MapNoInt; // No match
-  }
-
-  PCRE2_SIZE *ovector = pcre2_get_ovector_pointer(symMat);
-  DmmSymAddr outAddr = strtoul(objdumpLine + ovector[2], NULL, 16);
-  // Extract symbol name (second captured group)
-  size_t nameLen = ovector[5] - ovector[4];
-  if (nameLen >= *outBufSz)
-    nameLen = *outBufSz - 1;
-  strncpy(outBuf, objdumpLine + ovector[4], nameLen);
-  outBuf[nameLen] = '\0';
-  *outBufSz = nameLen;
-  return outAddr; // Success
+// Symbol lines: "addr [lg] flags section\tsize name", as printed by
+// `objdump -t`. Flags are a run of spaces, then maybe of [dfFO], then a space.
+DmmSymAddr ObjdLnToSym(const char *objdumpLine, size_t linesz,
+                       const char **name, size_t *nameSz) {
+  const char *l = objdumpLine;
+  *nameSz = 0;
+  if (linesz < 11 || !isHexRun(l, 8) || l[8] != ' ' ||
+      (l[9] != 'l' && l[9] != 'g') || l[10] != ' ')
+    return MapNoInt;
+  size_t at = 10, sect;
+  while (at < linesz && l[at] == ' ')
+    ++at;
+  size_t flags = at;
+  while (at < linesz && (l[at] == 'd' || l[at] == 'f' || l[at] == 'F' ||
+                         l[at] == 'O'))
+    ++at;
+  if (at > flags && at < linesz && l[at] == ' ')
+    sect = at + 1;
+  else if (flags - 10 >= 2)
+    sect = flags; // No flags, the section follows the last space
+  else
+    return MapNoInt;
+  // Section, then a tab
+  for (at = sect; at < linesz && !isSpace(l[at]); ++at);
+  if (at == sect || at >= linesz || l[at] != '\t')
+    return MapNoInt;
+  // Size and name, which ends the line
+  ++at;
+  if (linesz - at < 10 || !isHexRun(l + at, 8) || l[at + 8] != ' ')
+    return MapNoInt;
+  at += 9;
+  size_t nameAt = at;
+  while (at < linesz && !isSpace(l[at]))
+    ++at;
+  if (at == nameAt || !isEnd(l, linesz, at))
+    return MapNoInt;
+  *name = l + nameAt;
+  *nameSz = at - nameAt;
+  return strtoul(l, NULL, 16);
 }
 
 // Store instructions. The expected order of fields is:
 //	[regA?] [immA?] [regB?] [immB?]
-static UmmInstr stores(const char* fields, const PCRE2_SIZE *ovector,
+static UmmInstr stores(const char* fields, const size_t *ovector,
                        size_t nrFields, DmmMap symbols) {
   // Extract opcode
   const char* opcode = fields + ovector[0];
   size_t opcodeLen = ovector[1] - ovector[0];
   UmmInstr instr = {
-    .Opcode = DmmMapFetch(UmmStrToOpcode, opcode, opcodeLen),
+    .Opcode = parseOpcode(opcode, opcodeLen),
     .Cond = NoCond,
     .RegC = NullReg, .RegA = ZeroReg, .RegB = ZeroReg,
     .ImmA = ZeroImm, .ImmB = ZeroImm,
   };
   // Lookup opcode in stringToOpcode map
-  if (instr.Opcode == MapNoInt)
+  if (instr.Opcode == badOpcode)
     return instr;
   size_t curAt = 1;
   // Helper to access field `curAt` safely
@@ -194,20 +292,21 @@ static UmmInstr stores(const char* fields, const PCRE2_SIZE *ovector,
   return instr;
 }
 
-static UmmInstr subs(const char* fields, const PCRE2_SIZE *ovector,
+static UmmInstr subs(const char* fields, const size_t *ovector,
                        size_t nrFields, DmmMap symbols) {
   // Extract opcode
   const char* opcode = fields + ovector[0];
   size_t opcodeLen = ovector[1] - ovector[0];
   UmmInstr instr = {
-    .Opcode = DmmMapFetch(UmmStrToOpcode, opcode, opcodeLen),
+    .Opcode = parseOpcode(opcode, opcodeLen),
   // 1. regC is required
     .RegC = parseRegister(FIELD_AT(1)),
     .RegA = ZeroReg, .RegB = ZeroReg,
     .ImmA = ZeroImm, .ImmB = ZeroImm, .Cond = NoCond,
+    .Flags = UmmIfSextA, // immediates here are signed: `ra - rb - immA`
   };
   // Lookup opcode in stringToOpcode map
-  if (instr.Opcode == MapNoInt)
+  if (instr.Opcode == badOpcode)
     return instr;
 
   if (instr.RegC == ZeroReg)
@@ -226,7 +325,7 @@ static UmmInstr subs(const char* fields, const PCRE2_SIZE *ovector,
   // 4. optional condition and pc
   size_t curAt = 4;
   if (curAt < nrFields) {
-    UmmCc cond = DmmMapFetch(UmmStrToCc, FIELD_AT(curAt));
+    uint_fast32_t cond = DmmMapFetch(UmmStrToCc, FIELD_AT(curAt));
     if (cond != MapNoInt) {
       instr.Cond = cond;
       curAt++;
@@ -240,7 +339,7 @@ static UmmInstr subs(const char* fields, const PCRE2_SIZE *ovector,
   return instr;
 }
 
-static UmmInstr jumps(const char* fields, const PCRE2_SIZE *ovector,
+static UmmInstr jumps(const char* fields, const size_t *ovector,
                       size_t nrFields, DmmMap symbols) {
   UmmInstr instr = {
     .Opcode = JMP, .Cond = NoCond,
@@ -274,7 +373,8 @@ static UmmInstr jumps(const char* fields, const PCRE2_SIZE *ovector,
   // Handle conditional jumps: First parse condition from jmpcode[1:] (this is
   // the "condition" suffix of the opcode itself).
   // See what the macro expands into [Chuckle]
-  instr.Cond = DmmMapFetch(UmmStrToJcc, 1 + FIELD_AT(0) - 1);
+  uint_fast32_t cond = DmmMapFetch(UmmStrToJcc, 1 + FIELD_AT(0) - 1);
+  instr.Cond = cond == MapNoInt ? badCond : cond;
   // Last field (fields[l]) is always ImmB
   instr.ImmB = parseImmediate(FIELD_AT(l), symbols);
   assert(instr.ImmB != MapNoInt);
@@ -294,16 +394,16 @@ static UmmInstr jumps(const char* fields, const PCRE2_SIZE *ovector,
   return instr;
 }
 
-static UmmInstr allothers(const char* fields, const PCRE2_SIZE *ovector,
+static UmmInstr allothers(const char* fields, const size_t *ovector,
                           size_t nrFields, DmmMap symbols) {
   const char* opcode = fields + ovector[0];
   size_t opcodeLen = ovector[1] - ovector[0];
   UmmInstr instr = {
     .RegC = NullReg, .RegA = ZeroReg, .RegB = ZeroReg,
     .ImmA = ZeroImm, .ImmB = ZeroImm,
-    .Cond = NoCond, .Opcode = DmmMapFetch(UmmStrToOpcode, opcode, opcodeLen)
+    .Cond = NoCond, .Opcode = parseOpcode(opcode, opcodeLen)
   };
-  if (instr.Opcode == MapNoInt)
+  if (instr.Opcode == badOpcode)
     exit(fprintf(stderr, "Unrecognized opcode %.*s\n", (int)opcodeLen, opcode));
   size_t curAt = 1;
 
@@ -343,7 +443,7 @@ static UmmInstr allothers(const char* fields, const PCRE2_SIZE *ovector,
   }
   // 4. Parse condition (stringToCondition lookup)
   if (curAt < nrFields) {
-    UmmCc cond = DmmMapFetch(UmmStrToCc, FIELD_AT(curAt));
+    uint_fast32_t cond = DmmMapFetch(UmmStrToCc, FIELD_AT(curAt));
     if (cond != MapNoInt) {
       instr.Cond = cond;
       curAt++;
@@ -371,7 +471,7 @@ static UmmInstr allothers(const char* fields, const PCRE2_SIZE *ovector,
   return instr;
 }
 
-static uint32_t parseImmediate(const char *imm, PCRE2_SIZE sz,
+static uint32_t parseImmediate(const char *imm, size_t sz,
                                DmmMap symbols) {
   char* endptr;
   long val = strtol(imm, &endptr, 0);  // Handles decimal & hex (0x)
@@ -380,7 +480,12 @@ static uint32_t parseImmediate(const char *imm, PCRE2_SIZE sz,
   return DmmMapFetch(symbols, (void*)imm, sz);
 }
 
-static uint8_t parseRegister(const char* reg, PCRE2_SIZE sz) {
+static uint8_t parseOpcode(const char* opcode, size_t sz) {
+  uint_fast32_t op = DmmMapFetch(UmmStrToOpcode, opcode, sz);
+  return op == MapNoInt ? badOpcode : op;
+}
+
+static uint8_t parseRegister(const char* reg, size_t sz) {
   if (reg[0] == 'r' || reg[0] == 'd') {
     char* endptr;
     size_t num = strtoul(reg+1, &endptr, 10);
@@ -398,45 +503,73 @@ static uint8_t parseRegister(const char* reg, PCRE2_SIZE sz) {
   return badReg;  // Default case
 }
 
+// The file mapped read-only, followed by at least one NUL
+static const char *mapText(const char *filename, size_t *sz) {
+  int fd = open(filename, O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return NULL;
+  struct stat st;
+  char *text = MAP_FAILED;
+  if (fstat(fd, &st) == 0 && st.st_size > 0) {
+    // Zeros past the file's last page, where a mapping of it would fault
+    text = mmap(NULL, st.st_size + 1, PROT_READ,
+                MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+    if (text != MAP_FAILED &&
+        mmap(text, st.st_size, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0) ==
+        MAP_FAILED) {
+      munmap(text, st.st_size + 1);
+      text = MAP_FAILED;
+    }
+  }
+  close(fd);
+  if (text == MAP_FAILED)
+    return NULL;
+  madvise(text, st.st_size, MADV_SEQUENTIAL);
+  *sz = st.st_size;
+  return text;
+}
+
 size_t UmmPrgLoadBinary(UmmPrg *p, const char *filename, DmmMap symbols,
                          bool paged[WMAINrPage]) {
-  FILE* scanner = fopen(filename, "rb");
-  if (scanner == NULL) return 0;
-  char first32[32]= {};
-  fread(first32, 32, 1, scanner);
+  size_t textSz;
+  const char *text = mapText(filename, &textSz);
+  if (text == NULL) return 0;
   for (size_t i = 0; i < 32; ++i)
-    if (first32[i] < '\t' || first32[i] > '~') {
-      fclose(scanner);
+    if (i >= textSz || text[i] < '\t' || text[i] > '~') {
+      munmap((void*)text, textSz + 1);
       return 0;
     }
-  rewind(scanner);
 
   UmmPrgInit(p, -1);
+  p->Iram = UmmIramAlloc(-1);
   size_t iramAt = 0;
   if (paged != NULL)
     memset(paged, 0, WMAINrPage);
 
-  while (!feof(scanner)) {
-    char line[256], outBuf[128];
-    fgets(line, 256, scanner);
-    size_t lineSz = strlen(line), outBufSz = 128;
+  for (const char *line = text, *end = text + textSz, *next; line < end;
+       line = next) {
+    next = memchr(line, '\n', end - line);
+    next = next == NULL ? end : next + 1;
+    size_t lineSz = next - line;
     // If the line is a symbol definition, add it to the symbols table.
-    DmmSymAddr symAddr = ObjdLnToSym(line, lineSz, outBuf, &outBufSz);
-    if (outBufSz != 0) {
-      assert(outBufSz < 128 && "Symbol length >=128 not supported!");
-      // TODO: symbol names leaked!!!
-      char* name = strndup(outBuf, outBufSz);
-      DmmMapAssign(symbols, name, outBufSz, symAddr);
+    const char *name;
+    size_t nameSz;
+    DmmSymAddr symAddr = ObjdLnToSym(line, lineSz, &name, &nameSz);
+    if (nameSz != 0) {
+      DmmMapAssignCopy(symbols, name, nameSz, symAddr);
       continue;
     }
 
     // Otherwise, try to parse the line as an instruction.
     UmmInstr instr = ObjdLnToInstr(line, lineSz, symbols);
-    if (instr.Opcode != MapNoInt) {
+    if (instr.Opcode != badOpcode) {
       p->Iram[iramAt++] = instr;
       if (iramAt >= IramNrInstr) {
         fputs("UPMEM program can only hold 4096 instructions\n", stderr);
-        fclose(scanner);
+        munmap((void*)text, textSz + 1);
+        UmmIramFree(p->Iram);
+        p->Iram = NULL;
+        UmmPrgFini(p);
         return 0;
       }
       continue;
@@ -458,12 +591,12 @@ size_t UmmPrgLoadBinary(UmmPrg *p, const char *filename, DmmMap symbols,
     uint32_t *dest = (uint32_t*)(p->WMAram + dat.Addr);
     switch (dat.NrDat) {
     default: __builtin_unreachable();
-    case 4: dest[3] = dat.Dat[3];
-    case 3: dest[2] = dat.Dat[2];
-    case 2: dest[1] = dat.Dat[1];
+    case 4: dest[3] = dat.Dat[3]; // fallthrough
+    case 3: dest[2] = dat.Dat[2]; // fallthrough
+    case 2: dest[1] = dat.Dat[1]; // fallthrough
     case 1: dest[0] = dat.Dat[0];
     }
   }
-  fclose(scanner);
+  munmap((void*)text, textSz + 1);
   return iramAt;
 }
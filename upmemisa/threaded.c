@@ -0,0 +1,458 @@
+#include "dmminternal.h"
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef __clang__
+#define rotl32c __builtin_rotateleft32
+#define rotr32c __builtin_rotateright32
+#else
+static uint32_t rotl32c (uint32_t x, uint32_t n) {
+  assert (n<32);
+  return (x<<n) | (x>>(-n&31));
+}
+static uint32_t rotr32c (uint32_t x, uint32_t n) {
+  assert (n<32);
+  return (x>>n) | (x<<(-n&31));
+}
+#endif
+
+// Threaded-code engine for functional-only simulation of the UPMEM ISA.
+// UmmDpuExecuteInstr walks three switches per instruction: opcode, writeback
+// mode and condition. Here each of them is resolved at dpu_load into a label
+// address, so an instruction runs as Op -> Wb -> Cc -> Fin, and stages with
+// nothing to do are skipped by pointing at the next one. Jump targets become
+// stream indices. Conditional `jmp`s compare and jump in a single handler.
+// Like the RV engine, a tasklet keeps the host thread until it executes an
+// instruction that can jump or changes a tasklet's state.
+
+// Conditions usable by set-register and jump forms, with their evaluation
+#define UMM_CCS(X)                                                             \
+  X(TRUE, true) X(FALSE, false)                                                \
+  X(Z, (uint32_t)result == 0) X(NZ, (uint32_t)result != 0)                     \
+  X(SZ, va == 0) X(SNZ, va != 0)                                               \
+  X(PL, (int32_t)result >= 0) X(MI, (int32_t)result < 0)                       \
+  X(SPL, (int32_t)va >= 0) X(SMI, (int32_t)va < 0)                             \
+  X(C, result >> 32 != 0) X(NC, result >> 32 == 0)                             \
+  UMM_JCCS(X)                                                                  \
+  X(XZ, XVA == XVB) X(NXZ, XVA != XVB) X(XLEU, XVA <= XVB)                     \
+  X(XGTU, XVA > XVB) X(XLES, (int64_t)XVA <= (int64_t)XVB)                     \
+  X(XGTS, (int64_t)XVA > (int64_t)XVB)                                         \
+  X(SE, !(va & 1)) X(SO, (va & 1)) X(NSH32, !(vb & 32)) X(SH32, (vb & 32))     \
+  X(MAX, result == ip->CcArg) X(NMAX, result != ip->CcArg)                     \
+  X(SMALL, !((va | vb) & 0xff00)) X(LARGE, ((va | vb) & 0xff00))
+// Conditions that only look at va and vb, fused into `jmp`
+#define UMM_JCCS(X)                                                            \
+  X(LTU, (uint32_t)va <  (uint32_t)vb) X(GEU, (uint32_t)va >= (uint32_t)vb)    \
+  X(LEU, (uint32_t)va <= (uint32_t)vb) X(GTU, (uint32_t)va >  (uint32_t)vb)    \
+  X(LTS, (int32_t)va <  (int32_t)vb) X(GES, (int32_t)va >= (int32_t)vb)        \
+  X(LES, (int32_t)va <= (int32_t)vb) X(GTS, (int32_t)va >  (int32_t)vb)        \
+  X(EQ, va == vb) X(NEQ, va != vb)
+#define XVA ((va << 32) + R[ip->RegA + 1])
+#define XVB (((uint64_t)R[ip->RegB] << 32) + R[ip->RegB + 1])
+
+static bool ummTc(UmmDpu *d, size_t nrTasklets, UmmTcInstr *out,
+                  const UmmInstr *iram) {
+  static const void *const opTbl[NrOpcode] = {
+    [LDMA] = &&LDMA, [LDMAI] = &&LDMAI, [SDMA] = &&SDMA,
+    [MUL_STEP] = &&MUL_STEP, [DIV_STEP] = &&DIV_STEP,
+    [MOVD] = &&MOVD, [SWAPD] = &&SWAPD,
+    [MOVE] = &&MOVE, [MOVE_S] = &&MOVE, [MOVE_U] = &&MOVE,
+    [LD] = &&LD, [LW] = &&LW, [LW_S] = &&LW, [LW_U] = &&LW,
+    [LHS] = &&LHS, [LHS_S] = &&LHS, [LHU] = &&LHU, [LHU_U] = &&LHU,
+    [LBS] = &&LBS, [LBS_S] = &&LBS, [LBU] = &&LBU, [LBU_U] = &&LBU,
+    [SD] = &&SD, [SW] = &&SW, [SH] = &&SH, [SB] = &&SB,
+    [SD_ID] = &&SD_ID, [SW_ID] = &&SW_ID, [SH_ID] = &&SH_ID, [SB_ID] = &&SB_ID,
+    [EXTSB] = &&EXTSB, [EXTSB_S] = &&EXTSB, [EXTSH] = &&EXTSH,
+    [EXTSH_S] = &&EXTSH, [EXTUB] = &&EXTUB, [EXTUB_U] = &&EXTUB,
+    [EXTUH] = &&EXTUH, [EXTUH_U] = &&EXTUH,
+    [MUL_SH_SH] = &&MUL_SH_SH, [MUL_SH_SH_S] = &&MUL_SH_SH,
+    [MUL_SL_SH] = &&MUL_SL_SH, [MUL_SL_SH_S] = &&MUL_SL_SH,
+    [MUL_SL_SL] = &&MUL_SL_SL, [MUL_SL_SL_S] = &&MUL_SL_SL,
+    [MUL_SH_SL] = &&MUL_SH_SL, [MUL_SH_SL_S] = &&MUL_SH_SL,
+    [MUL_SH_UH] = &&MUL_SH_UH, [MUL_SH_UH_S] = &&MUL_SH_UH,
+    [MUL_SL_UH] = &&MUL_SL_UH, [MUL_SL_UH_S] = &&MUL_SL_UH,
+    [MUL_SL_UL] = &&MUL_SL_UL, [MUL_SL_UL_S] = &&MUL_SL_UL,
+    [MUL_SH_UL] = &&MUL_SH_UL, [MUL_SH_UL_S] = &&MUL_SH_UL,
+    [MUL_UH_SH] = &&MUL_UH_SH, [MUL_UH_SH_S] = &&MUL_UH_SH,
+    [MUL_UL_SH] = &&MUL_UL_SH, [MUL_UL_SH_S] = &&MUL_UL_SH,
+    [MUL_UL_SL] = &&MUL_UL_SL, [MUL_UL_SL_S] = &&MUL_UL_SL,
+    [MUL_UH_SL] = &&MUL_UH_SL, [MUL_UH_SL_S] = &&MUL_UH_SL,
+    [MUL_UH_UH] = &&MUL_UH_UH, [MUL_UH_UH_U] = &&MUL_UH_UH,
+    [MUL_UL_UH] = &&MUL_UL_UH, [MUL_UL_UH_U] = &&MUL_UL_UH,
+    [MUL_UL_UL] = &&MUL_UL_UL, [MUL_UL_UL_U] = &&MUL_UL_UL,
+    [MUL_UH_UL] = &&MUL_UH_UL, [MUL_UH_UL_U] = &&MUL_UH_UL,
+    [CLS] = &&CLS, [CLS_U] = &&CLS, [CLZ] = &&CLZ, [CLZ_U] = &&CLZ,
+    [CLO] = &&CLO, [CLO_U] = &&CLO, [CAO] = &&CAO, [CAO_U] = &&CAO,
+    [JMP] = &&JMP, [CALL] = &&CALL,
+    [ACQUIRE] = &&ACQUIRE, [RELEASE] = &&RELEASE, [STOP] = &&STOP,
+    [BOOT] = &&BOOT, [RESUME] = &&RESUME, [NOP] = &&NOP,
+    [ADD] = &&ADD, [ADD_S] = &&ADD, [ADD_U] = &&ADD,
+    [ADDC] = &&ADDC, [ADDC_S] = &&ADDC, [ADDC_U] = &&ADDC,
+    [SUB] = &&SUB, [SUB_S] = &&SUB, [SUB_U] = &&SUB,
+    [SUBC] = &&SUBC, [SUBC_S] = &&SUBC, [SUBC_U] = &&SUBC,
+    [AND] = &&AND, [AND_S] = &&AND, [AND_U] = &&AND,
+    [NAND] = &&NAND, [NAND_S] = &&NAND, [NAND_U] = &&NAND,
+    [ANDN] = &&ANDN, [ANDN_S] = &&ANDN, [ANDN_U] = &&ANDN,
+    [OR] = &&OR, [OR_S] = &&OR, [OR_U] = &&OR,
+    [NOR] = &&NOR, [NOR_S] = &&NOR, [NOR_U] = &&NOR,
+    [ORN] = &&ORN, [ORN_S] = &&ORN, [ORN_U] = &&ORN,
+    [XOR] = &&XOR, [XOR_S] = &&XOR, [XOR_U] = &&XOR,
+    [NXOR] = &&NXOR, [NXOR_S] = &&NXOR, [NXOR_U] = &&NXOR,
+    [NEG] = &&NEG, [NOT] = &&NOT,
+    [ROL] = &&ROL, [ROL_S] = &&ROL, [ROL_U] = &&ROL,
+    [ROR] = &&ROR, [ROR_S] = &&ROR, [ROR_U] = &&ROR,
+    [LSL] = &&LSL, [LSL_S] = &&LSL, [LSL_U] = &&LSL,
+    [LSR] = &&LSR, [LSR_S] = &&LSR, [LSR_U] = &&LSR,
+    [ASR] = &&ASR, [ASR_S] = &&ASR, [ASR_U] = &&ASR,
+    [LSLX] = &&LSLX, [LSLX_S] = &&LSLX, [LSLX_U] = &&LSLX,
+    [LSRX] = &&LSRX, [LSRX_S] = &&LSRX, [LSRX_U] = &&LSRX,
+    [ROL_ADD] = &&ROL_ADD, [ROL_ADD_S] = &&ROL_ADD, [ROL_ADD_U] = &&ROL_ADD,
+    [LSR_ADD] = &&LSR_ADD, [LSR_ADD_S] = &&LSR_ADD, [LSR_ADD_U] = &&LSR_ADD,
+    [LSL_SUB] = &&LSL_SUB, [LSL_SUB_S] = &&LSL_SUB, [LSL_SUB_U] = &&LSL_SUB,
+    [LSL_ADD] = &&LSL_ADD, [LSL_ADD_S] = &&LSL_ADD, [LSL_ADD_U] = &&LSL_ADD,
+  };
+  static const void *const wbTbl[] = {
+    [wbNoZf] = &&WB, [wbZf] = &&WB, [wbNoZf_s] = &&WB_S, [wbZf_s] = &&WB_S,
+    [wbNoZf_u] = &&WB_U, [wbZf_u] = &&WB_U, [wbShAdd] = &&WB_SHADD,
+    [wbShAdd_s] = &&WB_SHADD_S, [wbShAdd_u] = &&WB_SHADD_U,
+  };
+#define CC_LABELS(c, expr) [c] = &&CR_##c,
+  static const void *const ccRegTbl[NrConds] = { UMM_CCS(CC_LABELS) };
+#undef CC_LABELS
+#define CC_LABELS(c, expr) [c] = &&CJ_##c,
+  static const void *const ccJmpTbl[NrConds] = { UMM_CCS(CC_LABELS) };
+#undef CC_LABELS
+#define CC_LABELS(c, expr) [c] = &&JF_##c,
+  static const void *const jmpTbl[NrConds] = {
+    UMM_JCCS(CC_LABELS) CC_LABELS(TRUE, 0) CC_LABELS(FALSE, 0)
+  };
+#undef CC_LABELS
+
+  // Translation mode
+  if (out != NULL) {
+    for (size_t i = 0; i < IramNrInstr; ++i) {
+      const UmmInstr *in = &iram[i];
+      UmmTcInstr *o = &out[i];
+      UmmOpcode op = in->Opcode;
+      bool isJump = in->ImmB > IramMask && in->Cond != NoCond;
+      o->RegA = in->RegA; o->RegB = in->RegB; o->RegC = in->RegC;
+      o->ImmA = UmmImmA(in); o->ImmB = in->ImmB;
+      o->CcArg = op == CLS ? 31 : 32;
+      if (isJump || op == MUL_STEP) {
+        size_t tgt = (in->ImmB & IramMask) / IramNrByte;
+        o->ImmB = tgt < IramNrInstr ? tgt : IramNrInstr;
+      }
+      // Instructions touching tasklet states end the tasklet's turn
+      o->Fin = (op == STOP || op == BOOT || op == RESUME || op == ACQUIRE ||
+                op == RELEASE) ? &&YIELD : &&NEXT;
+      if (in->Cond == NoCond) o->Cc = o->Fin;
+      else if ((unsigned)in->Cond >= NrConds) o->Cc = &&CCBAD;
+      else o->Cc = isJump ? ccJmpTbl[in->Cond] : ccRegTbl[in->Cond];
+      if (o->Cc == NULL) o->Cc = &&CCBAD;
+      if ((unsigned)op >= NrOpcode || opTbl[op] == NULL) {
+        o->Op = o->Wb = &&UNSUPPORTED;
+        continue;
+      }
+      o->Op = opTbl[op];
+      o->Wb = UmmOpWbMode[op] == noWb ? o->Cc : wbTbl[UmmOpWbMode[op]];
+      // These return before writeback and condition handling
+      switch (op) {
+      case LDMA: case SDMA: case DIV_STEP: case LD: case SD: case SW: case SH:
+      case SB: case SD_ID: case SW_ID: case SH_ID: case SB_ID: case NOP:
+        o->Wb = o->Fin; break;
+      default: break;
+      }
+      if (op == JMP && isJump && jmpTbl[in->Cond] != NULL)
+        o->Op = jmpTbl[in->Cond];
+    }
+    // A label address is code, yet GCC 12+ flags storing it as a dangling one
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 12
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wdangling-pointer"
+#endif
+    out[IramNrInstr] = (UmmTcInstr){.Op = &&OOB};
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 12
+#pragma GCC diagnostic pop
+#endif
+    return true;
+  }
+
+  // Execution mode. Tasklets are visited round-robin in increasing id order,
+  // like the switch-based functional loop in UmmDpuRun.
+  const UmmTcInstr *code = d->Program.Tc, *ip;
+  const UmmTcInstr *ips[MaxNumTasklets];
+  UmmTlet *thrds = d->Timing.Threads, *thr;
+  uint8_t *wma = d->Program.WMAram;
+  uint32_t *R, run = 0, all = (1u << nrTasklets) - 1;
+  uint64_t va, vb, result;
+  long nrExec = 0;
+  size_t cur;
+  // Refresh the set of runnable tasklets after a state change
+#define RUNMASK() (run = d->Timing.runMask & all)
+  for (size_t i = 0; i < nrTasklets; ++i)
+    ips[i] = &code[thrds[i].Pc / IramNrByte];
+  RUNMASK();
+  if (run == 0) return false;
+  goto roundEnd;
+
+#define DISPATCH() do {                                                        \
+    ++nrExec; ips[cur] = ip;                                                   \
+    uint32_t m_ = run & (~1u << cur);                                          \
+    if (__builtin_expect(m_ == 0, 0)) goto roundEnd;                           \
+    cur = __builtin_ctz(m_);                                                   \
+    goto enter;                                                                \
+  } while (0)
+#define WBNEXT() goto *ip->Wb
+#define RA ip->RegA
+#define RB ip->RegB
+#define RC ip->RegC
+#define IMMA ip->ImmA
+#define MEM(ty) (*(ty*)(wma + (uint32_t)(va + IMMA)))
+
+roundEnd:
+  DmmMailboxPoll(&d->Mailbox, wma, d->Timing.StatNrInstrExec + nrExec);
+  if (run == 0) goto done;
+  cur = __builtin_ctz(run);
+enter:
+  ip = ips[cur]; thr = &thrds[cur]; R = thr->Regs;
+  va = R[RA]; vb = R[RB]; result = 0;
+  goto *ip->Op;
+
+  // Stage ends. NEXT keeps the tasklet, YIELD moves on to the next one.
+NEXT:
+  ++nrExec; ++ip;
+  va = R[RA]; vb = R[RB]; result = 0;
+  goto *ip->Op;
+YIELD:
+  ++ip; DISPATCH();
+
+LDMA: {
+  __auto_type w = va & 0xfffff8;
+  __auto_type m = vb & 0xfffffff8;
+  size_t N = (1 + ((IMMA + (va >> 24)) & 0xff)) << 3;
+  memcpy(wma + w, wma + WramSize + m, N);
+  WBNEXT();
+}
+LDMAI: exit(fputs("LDMAI not supported", stderr));
+SDMA: {
+  __auto_type w = va & 0xfffff8;
+  __auto_type m = vb & 0xfffffff8;
+  size_t N = (1 + ((IMMA + (va >> 24)) & 0xff)) << 3;
+  memcpy(wma + WramSize + m, wma + w, N);
+  WBNEXT();
+}
+
+MUL_STEP:
+  if (vb & 1)
+    R[1] += va << IMMA;
+  if (0 == (R[0] = vb >> 1)) {
+    ip = &code[ip->ImmB];
+    DISPATCH();
+  }
+  goto *ip->Fin;
+DIV_STEP:
+  if (IMMA == 0) {
+    vb = R[1];
+    R[1] = vb % va;
+    R[0] = vb / va;
+  }
+  WBNEXT();
+
+MOVD: R[RC] = (uint32_t)va; R[RC + 1] = R[RA + 1]; WBNEXT();
+SWAPD: R[RC] = R[RA + 1]; R[RC + 1] = (uint32_t)va; WBNEXT();
+MOVE: result = va + IMMA; WBNEXT();
+
+LD:
+  result = MEM(uint64_t);
+  R[RC + 1] = (uint32_t)result;
+  R[RC] = (uint32_t)(result >> 32);
+  WBNEXT();
+LW: result = MEM(uint32_t); WBNEXT();
+LHS: result = (int64_t)MEM(int16_t); WBNEXT();
+LHU: result = MEM(uint16_t); WBNEXT();
+LBS: result = (int64_t)MEM(int8_t); WBNEXT();
+LBU: result = MEM(uint8_t); WBNEXT();
+
+SD:
+  if (RB == ZeroReg) {
+    vb = (uint64_t)(int64_t)(int32_t)ip->ImmB;
+  } else {
+    vb = (uint64_t)R[RB] << 32;
+    vb += (uint64_t)R[RB + 1];
+  }
+  MEM(uint64_t) = vb; WBNEXT();
+SW: MEM(uint32_t) = vb + ip->ImmB; WBNEXT();
+SH: MEM(uint16_t) = vb + ip->ImmB; WBNEXT();
+SB: MEM(uint8_t) = vb + ip->ImmB; WBNEXT();
+SD_ID: MEM(int64_t) = thr->Id | (int64_t)ip->ImmB; WBNEXT();
+SW_ID: MEM(uint32_t) = thr->Id | ip->ImmB; WBNEXT();
+SH_ID: MEM(uint16_t) = thr->Id | ip->ImmB; WBNEXT();
+SB_ID: MEM(uint8_t) = thr->Id | ip->ImmB; WBNEXT();
+EXTSB: result = (uint64_t)(int64_t)(int8_t)va; WBNEXT();
+EXTSH: result = (uint64_t)(int64_t)(int16_t)va; WBNEXT();
+EXTUB: result = (uint64_t)(uint8_t)va; WBNEXT();
+EXTUH: result = (uint64_t)(uint16_t)va; WBNEXT();
+
+MUL_SH_SH: va >>= 8; // fallthrough
+MUL_SL_SH: vb >>= 8; // fallthrough
+MUL_SL_SL: result = (int64_t)(int8_t)va * (int64_t)(int8_t)vb; WBNEXT();
+MUL_SH_SL: result = (int64_t)(int8_t)(va >> 8) * (int64_t)(int8_t)vb; WBNEXT();
+MUL_SH_UH: va >>= 8; // fallthrough
+MUL_SL_UH: vb >>= 8; // fallthrough
+MUL_SL_UL: result = (int64_t)(int8_t)va * (vb & 255); WBNEXT();
+MUL_SH_UL: result = (int64_t)(int8_t)(va >> 8) * (vb & 255); WBNEXT();
+MUL_UH_SH: va >>= 8; // fallthrough
+MUL_UL_SH: vb >>= 8; // fallthrough
+MUL_UL_SL: result = (va & 255) * (int64_t)(int8_t)vb; WBNEXT();
+MUL_UH_SL: result = ((va >> 8) & 255) * (int64_t)(int8_t)vb; WBNEXT();
+MUL_UH_UH: va >>= 8; // fallthrough
+MUL_UL_UH: vb >>= 8; // fallthrough
+MUL_UL_UL: result = (va & 255) * (vb & 255); WBNEXT();
+MUL_UH_UL: result = ((va >> 8) & 255) * (vb & 255); WBNEXT();
+
+CLS: if (va & 0x80000000) { va = ~va; } // fallthrough
+CLZ: result = va == 0 ? 32 : __builtin_clz((uint32_t)va); WBNEXT();
+CLO: result = ~va == 0 ? 32 : __builtin_clz((uint32_t)~va); WBNEXT();
+CAO: result = __builtin_popcount((uint32_t)va); WBNEXT();
+
+JMP: vb += IMMA; WBNEXT();
+CALL: {
+  size_t tgt = ((va * IramNrByte + IMMA) & IramMask) / IramNrByte;
+  R[RC] = ip - code + 1;
+  ip = &code[tgt < IramNrInstr ? tgt : IramNrInstr];
+  DISPATCH();
+}
+
+#define ATOMIC(set) do {                                                       \
+    va = va + IMMA;                                                            \
+    va = (va ^ (va >> 8)) & 255;                                               \
+    result = wma[WramSize + MramSize + va];                                    \
+    wma[WramSize + MramSize + va] = set;                                       \
+    WBNEXT();                                                                  \
+  } while (0)
+ACQUIRE: ATOMIC(1);
+RELEASE: ATOMIC(0);
+STOP: UmmTletSetState(&d->Timing, thr->Id, SLEEP); RUNMASK(); WBNEXT();
+#define WAKE(boot) do {                                                        \
+    va = va + IMMA;                                                            \
+    va = (va ^ (va >> 8)) & 31;                                                \
+    result = thrds[va].State != SLEEP;                                         \
+    if (result) WBNEXT();                                                      \
+    UmmTletSetState(&d->Timing, va, RUNNABLE);                                 \
+    if (boot) {                                                                \
+      thrds[va].Pc = 0;                                                        \
+      if (va < nrTasklets) ips[va] = code;                                     \
+    }                                                                          \
+    RUNMASK();                                                                 \
+    WBNEXT();                                                                  \
+  } while (0)
+BOOT: WAKE(true);
+RESUME: WAKE(false);
+NOP: WBNEXT();
+
+ADD:
+  vb += IMMA; result = va + (uint32_t)vb;
+  thr->CarryFlag = result >> 32 != 0; WBNEXT();
+ADDC:
+  vb += IMMA; result = va + (uint32_t)vb + thr->CarryFlag;
+  thr->CarryFlag = result >> 32 != 0; WBNEXT();
+SUB:
+  vb += IMMA; result = va - vb;
+  thr->CarryFlag = result >> 32 != 0; WBNEXT();
+SUBC:
+  vb += IMMA + thr->CarryFlag; result = va - vb;
+  thr->CarryFlag = result >> 32 != 0; WBNEXT();
+AND: result = va & (vb += IMMA); WBNEXT();
+NAND: result = ~(va & (vb += IMMA)); WBNEXT();
+ANDN: result = ~va & (vb += IMMA); WBNEXT();
+OR: result = va | (vb += IMMA); WBNEXT();
+NOR: result = ~(va | (vb += IMMA)); WBNEXT();
+ORN: result = ~va | (vb += IMMA); WBNEXT();
+XOR: result = va ^ (vb += IMMA); WBNEXT();
+NXOR: result = ~(va ^ (vb += IMMA)); WBNEXT();
+NEG: result = -va; WBNEXT();
+NOT: result = ~va; WBNEXT();
+
+ROL: result = rotl32c((uint32_t)va, (vb + IMMA) & 31); WBNEXT();
+ROR: result = rotr32c((uint32_t)va, (vb + IMMA) & 31); WBNEXT();
+LSL: result = va << ((vb += IMMA) & 31); WBNEXT();
+LSR: result = va >> ((vb += IMMA) & 31); WBNEXT();
+ASR: result = (int32_t)va >> ((vb += IMMA) & 31); WBNEXT();
+LSLX: vb += IMMA; result = va << (vb & 31) >> 32; WBNEXT();
+LSRX: vb += IMMA; result = va << 32 >> (vb & 31); WBNEXT();
+ROL_ADD: result = rotl32c((uint32_t)vb, IMMA & 31); WBNEXT();
+LSR_ADD: result = vb >> (IMMA & 31); WBNEXT();
+LSL_SUB: result = -(vb << (IMMA & 31)); WBNEXT();
+LSL_ADD: result = vb << (IMMA & 31); WBNEXT();
+
+  // Writeback
+WB: R[RC] = (uint32_t)result; goto *ip->Cc;
+WB_S:
+  result = (int64_t)(int32_t)result;
+  R[RC] = result >> 32;
+  R[RC + 1] = result; goto *ip->Cc;
+WB_U: R[RC] = 0; R[RC + 1] = result; goto *ip->Cc;
+WB_SHADD: result += va; R[RC] = (uint32_t)result; goto *ip->Cc;
+WB_SHADD_U:
+  result += va;
+  R[RC + 1] = (uint32_t)result;
+  R[RC] = 0; goto *ip->Cc;
+WB_SHADD_S:
+  result = (int64_t)(int32_t)(result + va);
+  R[RC + 1] = (uint32_t)result;
+  R[RC] = (uint32_t)(result >> 32); goto *ip->Cc;
+
+  // Conditions: CR_* write the outcome to rc, CJ_* jump on it, JF_* are
+  // conditional `jmp`s done in one step
+#define CC_HANDLERS(c, expr)                                                   \
+  CR_##c: R[RC] = (uint32_t)(bool)(expr); goto *ip->Fin;                       \
+  CJ_##c: ip = (expr) ? &code[ip->ImmB] : ip + 1; DISPATCH();
+  UMM_CCS(CC_HANDLERS)
+#undef CC_HANDLERS
+#define JF_HANDLER(c, expr)                                                    \
+  JF_##c: vb += IMMA; ip = (expr) ? &code[ip->ImmB] : ip + 1; DISPATCH();
+  UMM_JCCS(JF_HANDLER) JF_HANDLER(TRUE, true) JF_HANDLER(FALSE, false)
+#undef JF_HANDLER
+
+CCBAD:
+  assert(false && "%d condition not supported\n");
+  __builtin_unreachable();
+UNSUPPORTED:
+  assert(fprintf(stderr, "%s not suported\n",
+                 UmmOpStr[d->Program.Iram[ip - code].Opcode]) && 0);
+  __builtin_unreachable();
+OOB:
+  assert(0 && "PC out of IRAM");
+  __builtin_unreachable();
+
+done:
+  for (size_t i = 0; i < nrTasklets; ++i)
+    thrds[i].Pc = (ips[i] - code) * IramNrByte;
+  d->Timing.StatNrInstrExec += nrExec;
+  return true;
+#undef RUNMASK
+#undef DISPATCH
+#undef WBNEXT
+#undef RA
+#undef RB
+#undef RC
+#undef IMMA
+#undef MEM
+#undef ATOMIC
+#undef WAKE
+}
+
+UmmTcInstr *UmmTcBuild(const UmmInstr *iram) {
+  UmmTcInstr *tc = malloc((IramNrInstr + 1) * sizeof(UmmTcInstr));
+  if (tc == NULL) {
+    perror("malloc UmmTcInstr");
+    exit(EXIT_FAILURE);
+  }
+  ummTc(NULL, 0, tc, iram);
+  return tc;
+}
+
+void UmmDpuRunTc(UmmDpu *d, size_t nrTasklets) {
+  ummTc(d, nrTasklets, NULL, NULL);
+}
@@ -26,15 +26,8 @@ static void serveCycleRule(UmmTiming* this) {
     UmmInstr* instr = this->CrCurInstr;
     this->CrCurInstr = NULL;
     long thread_id = this->CrCurId;
-    UmmOpcode op = instr->Opcode;
-
-    uint64_t curRead;
-    if (op == DIV_STEP || op == MUL_STEP || op == SD ||
-        op == MOVD || op == SWAPD) {
-      curRead = (1ull << instr->RegA) | (3ull << instr->RegB);
-    } else {
-      curRead = (1ull << instr->RegA) | (1ull << instr->RegB);
-    }
+    uint64_t curRead = (1ull << instr->RegA) |
+      ((instr->Flags & UmmIfRdPairB ? 3ull : 1ull) << instr->RegB);
     // printf(" r %ld %lx %x", thread_id, curRead & 0xffffff,
     //        this->CrPrevWriteRegSets[thread_id] & 0xffffff);
 
@@ -51,19 +44,58 @@ static void serveCycleRule(UmmTiming* this) {
     UmmInstr* instr = this->CrPrevInstr;
     this->CrPrevInstr = NULL;
     long thread_id = this->CrPrevId;
-    UmmOpcode op = instr->Opcode;
-    _Static_assert(LD + 1 == SOpcodeStart, "please dude");
-    if (op >= LD) {
-      this->CrPrevWriteRegSets[thread_id] = (3ull << instr->RegC);
-    } else {
-      this->CrPrevWriteRegSets[thread_id] = (1ull << instr->RegC);
-    }
+    this->CrPrevWriteRegSets[thread_id] =
+      (instr->Flags & UmmIfWrPair ? 3ull : 1ull) << instr->RegC;
     // printf(" w %ld %x", thread_id,
     //        this->CrPrevWriteRegSets[thread_id] & 0xffffff);
   }
   this->CrExtraCycleLeft -= 1;
 }
 
+#ifdef __DMM_EVENT_DRIVEN
+// While every tasklet waits on DMA (or sleeps) and only bubbles are in
+// flight, logic cycles are plain stalls until the MRAM model acks a tasklet.
+// Step only the MRAM model through them and account the stalls at once.
+static void fastForward(UmmTiming* this, size_t nrTasklets) {
+  if (this->PpInInstr != (UmmInstr*)1 || this->PpReadyInstr != (UmmInstr*)1 ||
+      this->CrCurInstr != NULL || this->CrPrevInstr != NULL ||
+      this->lastIssue >= nrTasklets || this->MramTiming.NrWait == 0 ||
+      DmmMramTimingCanPop(&this->MramTiming))
+    return;
+  if (((this->PpQRear - this->PpQFrt) & 15) != NrPipelineStage - 2)
+    return;
+  for (uint_fast8_t i = this->PpQFrt; i != this->PpQRear; i = (i + 1) & 15)
+    if (this->PpInsideInstrs[i] != (UmmInstr*)1)
+      return;
+  // Also wait out revolve windows so that every skipped cycle scans alike
+  uint32_t all = (1u << nrTasklets) - 1;
+  uint32_t cool = this->revolver.Mask & ~DmmRevolverExpiring(
+      &this->revolver, this->lastRunAt, this->TotNrCycle + 1);
+  if ((this->runMask | cool) & all)
+    return;
+
+  // The ack lands after the scheduler scan, so its cycle is a stall as well
+  long nrCycle = DmmMramTimingRunToAck(&this->MramTiming, this->FreqRatio,
+                                       this->TotNrCycle);
+  this->TotNrCycle += nrCycle; this->StatNrCycle += nrCycle;
+  // The scan ends on the tasklet just before lastIssue
+  size_t last = (this->lastIssue + nrTasklets - 1) % nrTasklets;
+  if (this->Threads[last].State == BLOCK) { this->StatDma += nrCycle; }
+  else { this->StatEtc += nrCycle; }
+  for (long i = 0; i < nrCycle && i < 16; i++) {
+    uint_fast8_t at = (this->PpQRear + i) & 15;
+    this->PpInsideInstrs[at] = (UmmInstr*)1;
+    this->PpInsideIds[at] = this->PpInId;
+  }
+  this->PpQRear = (this->PpQRear + nrCycle) & 15;
+  this->PpQFrt = (this->PpQFrt + nrCycle) & 15;
+  this->PpReadyId = this->PpInsideIds[(this->PpQFrt - 1) & 15];
+  this->CrExtraCycleLeft -= nrCycle;
+  DmmRevolverSkip(&this->revolver, this->lastRunAt, this->TotNrCycle);
+  UmmTletSetState(this, DmmMramTimingPop(&this->MramTiming), RUNNABLE);
+}
+#endif
+
 void UmmTimingInit(UmmTiming *t, UmmInstr *iram, size_t memFreq,
                    size_t logicFreq) {
   memset(t, 0, sizeof(UmmTiming));
@@ -76,6 +108,7 @@ void UmmTimingInit(UmmTiming *t, UmmInstr *iram, size_t memFreq,
   }
   t->FreqRatio = (double)memFreq / (double)logicFreq;
   DmmMramTimingInit(&t->MramTiming);
+  DmmRevolverInit(&t->revolver);
 
   // Push dummy entries to simulate initial pipeline stages
   for (size_t i = 0; i < NrPipelineStage - 1; i++) {
@@ -89,42 +122,54 @@ void UmmTimingInit(UmmTiming *t, UmmInstr *iram, size_t memFreq,
 }
 
 UmmTlet* UmmTimingCycle(UmmTiming* this, size_t nrTasklets) {
-  long num_memory_cycles = (long)(
-    this->FreqRatio * (double)this->TotNrCycle -
-    this->FreqRatio * (double)(this->TotNrCycle - 1));
+#ifdef __DMM_EVENT_DRIVEN
+  fastForward(this, nrTasklets);
+#endif
+  long num_memory_cycles = DmmMramCyclesAt(this->FreqRatio, this->TotNrCycle);
+#ifdef __DMM_EVENT_DRIVEN
+  DmmMramTimingRun(&this->MramTiming, num_memory_cycles);
+#else
   for (long i = 0; i < num_memory_cycles; i++) {
     DmmMramTimingCycle(&this->MramTiming);
   }
+#endif
   this->TotNrCycle++; this->StatNrCycle++;
+  DmmRevolverTick(&this->revolver, this->lastRunAt, this->TotNrCycle);
   UmmTlet* ret = NULL;
 
   if (this->PpInInstr != (UmmInstr*)1 || this->CrCurInstr != NULL) {
     this->StatNrRfHazard += 1;
   } else {
+    // Scan order starts at lastIssue, and tasklet i checks the revolve
+    // window of tasklet i+1. Masks below are rotated to scan order.
     bool is_blocked = false;
-    for (long i = 0; i < nrTasklets; i++) {
-      UmmTlet* thread = &this->Threads[this->lastIssue];
-      this->lastIssue++;
-      if (this->lastIssue == nrTasklets) { this->lastIssue = 0; }
-      if (this->lastRunAt[this->lastIssue] + NrRevolveCycle > this->TotNrCycle) {
-        continue;
-      }
-      if (thread->State != RUNNABLE) {
-        is_blocked = thread->State == BLOCK;
-        continue;
-      }
+    uint32_t all = (1u << nrTasklets) - 1;
+    unsigned from = this->lastIssue;
+    uint32_t open = ~DmmRotMask(this->revolver.Mask & all, 1 % nrTasklets,
+                                nrTasklets) & all;
+    uint32_t run = DmmRotMask(open & this->runMask, from, nrTasklets);
+    uint32_t idle = DmmRotMask(open & ~this->runMask, from, nrTasklets);
+    if (run != 0)
+      idle &= (1u << __builtin_ctz(run)) - 1;
+    // The last idle tasklet scanned before the issue tells DMA from the rest
+    if (idle != 0) {
+      size_t last = (from + 31 - __builtin_clz(idle)) % nrTasklets;
+      is_blocked = this->Threads[last].State == BLOCK;
+    }
+    if (run != 0) {
+      UmmTlet* thread = &this->Threads[(from + __builtin_ctz(run)) % nrTasklets];
+      this->lastIssue = (thread->Id + 1) % nrTasklets;
 
       size_t pc = (thread->Pc & IramMask) / IramNrByte;
       UmmInstr* instr = &this->Iram[pc];
       this->PpInInstr = instr;
       this->PpInId = thread->Id;
-      _Static_assert(SDMA == 2 && LDMAI == 1 && LDMA == 0, "Please dude");
-      if (instr->Opcode <= SDMA) {
+      if (instr->Flags & UmmIfDma) {
         __auto_type vc = thread->Regs[instr->RegA];
         __auto_type ad = (thread->Regs[instr->RegB] & 0xfffffff8);
         __auto_type sz = (1 + instr->ImmA + (vc >> 24) & 0xff) << 3;
         DmmMramTimingPush(&this->MramTiming, ad, sz, thread->Id);
-        thread->State = BLOCK;
+        UmmTletSetState(this, thread->Id, BLOCK);
       }
 
       // printf("t%d %s %d %d %d", thread->Id, UmmOpStr[instr->Opcode],
@@ -135,10 +180,10 @@ UmmTlet* UmmTimingCycle(UmmTiming* this, size_t nrTasklets) {
       this->lastPc[this->lastIssue] = pc;
 #endif
       this->lastRunAt[this->lastIssue] = this->TotNrCycle;
+      DmmRevolverSet(&this->revolver, this->lastIssue, this->TotNrCycle);
       this->StatNrInstrExec += 1;
       this->StatRun += 1;
       ret = thread;
-      break;
     }
     if (is_blocked) { this->StatDma += 1; } else { this->StatEtc += 1; }
   }
@@ -154,7 +199,7 @@ UmmTlet* UmmTimingCycle(UmmTiming* this, size_t nrTasklets) {
   }
 
   if (DmmMramTimingCanPop(&this->MramTiming)) {
-    this->Threads[DmmMramTimingPop(&this->MramTiming)].State = RUNNABLE;
+    UmmTletSetState(this, DmmMramTimingPop(&this->MramTiming), RUNNABLE);
   }
   servePipeline(this);
   serveCycleRule(this);
@@ -0,0 +1,394 @@
+#define _GNU_SOURCE
+#include "dmm_common.h"
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+#ifdef __DMM_NUMA
+#include <numa.h>
+#include <numaif.h>
+#endif
+
+// Freed images are kept per NUMA node and handed out again instead of mapping
+// fresh ones, so that pages a DPU wrote stay resident across dpu_load and
+// dpu_free: only those get zeroed again, in place, by the thread taking the
+// image rather than by page faults. Each image is followed by a header page
+// linking it into its node's free list.
+//
+// With DmmWmaSpillInit, images are instead shared mappings of a sparse file,
+// one range each: pages materialize on first touch and the kernel writes them
+// back to the file rather than failing when memory runs out. Images in use
+// are also kept least recently run first, and past the RSS cap the coldest
+// ones are paged out whole.
+typedef struct _wmaHdr {
+  struct _wmaHdr *Next;
+  size_t NrByte;
+  int Node;
+  size_t CowFrom, CowTo; // Pages mapped from a DmmWmaCow, none if equal
+  off_t SpillAt; // Where it lives in the spill file, negative if anonymous
+  struct _wmaHdr *LruPrev, *LruNext; // In use and spilled only
+  bool Out; // Paged out since last touched
+} _wmaHdr;
+enum { _wmaNrNode = 64, _wmaHdrNrByte = 4096 };
+static struct {
+  pthread_mutex_t Mu;
+  pthread_once_t Once;
+  int PagemapFd; // /proc/self/pagemap, negative if it cannot be read
+  _wmaHdr *Free[_wmaNrNode + 1]; // Index node + 1, 0 for any node
+  // Spilling, see DmmWmaSpillInit
+  int SpillFd, StatmFd;
+  off_t SpillEnd;
+  size_t CapNrPage; // 0 if uncapped
+  pthread_mutex_t TrimMu;
+  _wmaHdr Lru; // Sentinel; LruNext is the least recently touched
+} wmaPool = {PTHREAD_MUTEX_INITIALIZER, PTHREAD_ONCE_INIT, .SpillFd = -1,
+             .StatmFd = -1, .TrimMu = PTHREAD_MUTEX_INITIALIZER,
+             .Lru = {.LruPrev = &wmaPool.Lru, .LruNext = &wmaPool.Lru}};
+
+static inline uint8_t *_wmaOf(_wmaHdr *h) {
+  return (uint8_t*)h - h->NrByte;
+}
+static inline int _wmaSlot(int node) {
+  return node >= 0 && node < _wmaNrNode ? node + 1 : 0;
+}
+static void _wmaOpen(void) {
+  wmaPool.PagemapFd = open("/proc/self/pagemap", O_RDONLY | O_CLOEXEC);
+}
+
+// Advise and bind a fresh anonymous mapping within an image
+static void _wmaBind(uint8_t *at, size_t nrByte, int numaNode) {
+  if (madvise(at, nrByte, MADV_HUGEPAGE) != 0)
+    perror("madvise");
+  (void)numaNode;
+#ifdef __DMM_NUMA
+  if (numaNode >= 0) {
+    struct bitmask *mask = numa_allocate_nodemask();
+    numa_bitmask_setbit(mask, numaNode);
+    long ret = mbind(at, nrByte, MPOL_BIND, mask->maskp,
+                     mask->size + 1, MPOL_MF_MOVE | MPOL_MF_STRICT);
+    if (ret != 0)
+      perror("mbind WMAram");
+    numa_free_nodemask(mask);
+  }
+#endif
+}
+
+static _wmaHdr *_wmaMap(size_t nrByte, int numaNode) {
+  off_t spillAt = -1;
+  if (wmaPool.SpillFd >= 0) {
+    pthread_mutex_lock(&wmaPool.Mu);
+    spillAt = wmaPool.SpillEnd;
+    wmaPool.SpillEnd += nrByte + _wmaHdrNrByte;
+    if (ftruncate(wmaPool.SpillFd, wmaPool.SpillEnd) != 0) {
+      perror("ftruncate spill file");
+      exit(EXIT_FAILURE);
+    }
+    pthread_mutex_unlock(&wmaPool.Mu);
+  }
+  uint8_t *wma = spillAt < 0 ?
+    mmap(NULL, nrByte + _wmaHdrNrByte, PROT_READ | PROT_WRITE,
+         MAP_ANONYMOUS | MAP_PRIVATE, -1, 0) :
+    mmap(NULL, nrByte + _wmaHdrNrByte, PROT_READ | PROT_WRITE,
+         MAP_SHARED, wmaPool.SpillFd, spillAt);
+  if (wma == MAP_FAILED) {
+    perror("mmap");
+    exit(EXIT_FAILURE);
+  }
+  _wmaHdr *h = (_wmaHdr*)(wma + nrByte);
+  h->NrByte = nrByte;
+  h->Node = _wmaSlot(numaNode) != 0 ? numaNode : -1;
+  h->CowFrom = h->CowTo = 0;
+  h->SpillAt = spillAt;
+  // Page cache placement is first touch; huge pages are anonymous only
+  if (spillAt < 0)
+    _wmaBind(wma, nrByte, h->Node);
+  return h;
+}
+
+// Zero a used image. /proc/self/pagemap tells which pages are mapped by this
+// process alone, i.e. were written: those are cleared in place. Pages only
+// read map the shared zero page and, like swapped out ones, are dropped.
+enum {
+  _pmPresent = 63, _pmSwapped = 62, _pmExclusive = 56,
+  _wmaNrEntry = 512, // pagemap entries read at a time
+};
+// Written pages are usually cold by then: stream the zeros past the cache
+static inline void _wmaZeroPage(uint8_t *pg) {
+#if defined(__x86_64__)
+  __m128i z = _mm_setzero_si128(), *q = (__m128i*)pg;
+  for (size_t i = 0; i < 4096 / sizeof(__m128i); i += 4) {
+    _mm_stream_si128(q + i, z); _mm_stream_si128(q + i + 1, z);
+    _mm_stream_si128(q + i + 2, z); _mm_stream_si128(q + i + 3, z);
+  }
+#else
+  memset(pg, 0, 4096);
+#endif
+}
+static void _wmaReset(uint8_t *wma, size_t nrByte) {
+  _wmaHdr *h = (_wmaHdr*)(wma + nrByte);
+  if (h->SpillAt >= 0) {
+    // Holes read as zeros and take neither memory nor disk
+    if (fallocate(wmaPool.SpillFd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+                  h->SpillAt, nrByte) != 0) {
+      perror("fallocate spill file");
+      memset(wma, 0, nrByte);
+    }
+    return;
+  }
+  pthread_once(&wmaPool.Once, _wmaOpen);
+  if (wmaPool.PagemapFd < 0) {
+    if (madvise(wma, nrByte, MADV_DONTNEED) != 0)
+      perror("madvise");
+    return;
+  }
+  uint64_t pm[_wmaNrEntry];
+  size_t nrPage = nrByte / 4096, dropFrom = nrPage;
+  for (size_t at = 0; at < nrPage; at += _wmaNrEntry) {
+    size_t nr = nrPage - at < _wmaNrEntry ? nrPage - at : _wmaNrEntry;
+    off_t off = (uintptr_t)(wma + at * 4096) / 4096 * sizeof(uint64_t);
+    if (pread(wmaPool.PagemapFd, pm, nr * sizeof(uint64_t), off) !=
+        (ssize_t)(nr * sizeof(uint64_t))) {
+      // Cannot tell what is left: drop the rest
+      if (dropFrom == nrPage) dropFrom = at;
+      break;
+    }
+    for (size_t i = 0; i < nr; ++i) {
+      size_t pg = at + i;
+      bool drop = false;
+      if ((pm[i] >> _pmPresent & 1) && (pm[i] >> _pmExclusive & 1))
+        _wmaZeroPage(wma + pg * 4096);
+      else
+        drop = pm[i] >> _pmPresent & 1 || pm[i] >> _pmSwapped & 1;
+      // Drop runs of such pages with one call
+      if (drop && dropFrom == nrPage)
+        dropFrom = pg;
+      if (!drop && dropFrom != nrPage) {
+        madvise(wma + dropFrom * 4096, (pg - dropFrom) * 4096, MADV_DONTNEED);
+        dropFrom = nrPage;
+      }
+    }
+  }
+  if (dropFrom != nrPage)
+    madvise(wma + dropFrom * 4096, (nrPage - dropFrom) * 4096, MADV_DONTNEED);
+#if defined(__x86_64__)
+  _mm_sfence();
+#endif
+}
+
+// Least recently touched list, under wmaPool.Mu
+static void _wmaUnlink(_wmaHdr *h) {
+  h->LruPrev->LruNext = h->LruNext;
+  h->LruNext->LruPrev = h->LruPrev;
+}
+static void _wmaAppend(_wmaHdr *h) {
+  h->LruPrev = wmaPool.Lru.LruPrev; h->LruNext = &wmaPool.Lru;
+  h->LruPrev->LruNext = h; wmaPool.Lru.LruPrev = h;
+  h->Out = false;
+}
+static void _wmaLink(_wmaHdr *h) {
+  if (h->SpillAt < 0)
+    return;
+  pthread_mutex_lock(&wmaPool.Mu);
+  _wmaAppend(h);
+  pthread_mutex_unlock(&wmaPool.Mu);
+}
+
+uint8_t *DmmWmaAlloc(size_t nrByte, int numaNode) {
+  int slot = _wmaSlot(numaNode);
+  pthread_mutex_lock(&wmaPool.Mu);
+  _wmaHdr **at = &wmaPool.Free[slot];
+  while (*at != NULL && (*at)->NrByte != nrByte)
+    at = &(*at)->Next;
+  _wmaHdr *h = *at;
+  if (h != NULL)
+    *at = h->Next;
+  pthread_mutex_unlock(&wmaPool.Mu);
+  if (h == NULL) {
+    h = _wmaMap(nrByte, numaNode);
+    _wmaLink(h);
+    return _wmaOf(h);
+  }
+  uint8_t *wma = _wmaOf(h);
+  if (h->CowFrom != h->CowTo) {
+    // Back to anonymous zeros; a template's pages must not show through
+    size_t len = (h->CowTo - h->CowFrom) * 4096;
+    if (mmap(wma + h->CowFrom * 4096, len, PROT_READ | PROT_WRITE,
+             MAP_ANONYMOUS | MAP_PRIVATE | MAP_FIXED, -1, 0) == MAP_FAILED) {
+      perror("mmap");
+      exit(EXIT_FAILURE);
+    }
+    _wmaBind(wma + h->CowFrom * 4096, len, h->Node);
+    h->CowFrom = h->CowTo = 0;
+  }
+  _wmaReset(wma, nrByte);
+  _wmaLink(h);
+  return wma;
+}
+
+void DmmWmaFree(uint8_t *wma, size_t nrByte) {
+  if (wma == NULL)
+    return;
+  _wmaHdr *h = (_wmaHdr*)(wma + nrByte);
+  pthread_mutex_lock(&wmaPool.Mu);
+  if (h->SpillAt >= 0)
+    _wmaUnlink(h);
+  h->Next = wmaPool.Free[_wmaSlot(h->Node)];
+  wmaPool.Free[_wmaSlot(h->Node)] = h;
+  pthread_mutex_unlock(&wmaPool.Mu);
+}
+
+bool DmmWmaCowInit(DmmWmaCow *c, const uint8_t *wma, size_t nrByte,
+                   const bool *paged) {
+  size_t nrPage = nrByte / 4096, nrPaged = 0;
+  c->Fd = -1;
+  // Private copies of a template could not be spilled
+  if (wmaPool.SpillFd >= 0)
+    return false;
+  c->From = nrPage; c->To = 0;
+  for (size_t i = 0; i < nrPage; ++i) {
+    if (!paged[i]) continue;
+    if (c->From == nrPage) c->From = i;
+    c->To = i + 1;
+    ++nrPaged;
+  }
+  if (nrPaged < DmmWmaCowMinNrPage)
+    return false;
+  c->Fd = memfd_create("dmm-wma", MFD_CLOEXEC);
+  if (c->Fd < 0 || ftruncate(c->Fd, c->To * 4096) != 0)
+    goto fail;
+  for (size_t i = c->From; i < c->To; ++i)
+    if (paged[i] &&
+        pwrite(c->Fd, wma + i * 4096, 4096, i * 4096) != 4096)
+      goto fail;
+  return true;
+fail:
+  perror("memfd WMAram template");
+  DmmWmaCowFini(c);
+  return false;
+}
+
+void DmmWmaCowMap(const DmmWmaCow *c, uint8_t *wma, size_t nrByte) {
+  _wmaHdr *h = (_wmaHdr*)(wma + nrByte);
+  size_t len = (c->To - c->From) * 4096;
+  if (mmap(wma + c->From * 4096, len, PROT_READ | PROT_WRITE,
+           MAP_PRIVATE | MAP_FIXED, c->Fd, c->From * 4096) == MAP_FAILED) {
+    perror("mmap");
+    exit(EXIT_FAILURE);
+  }
+  // Not bound: the pages are the template's, shared by every image mapping
+  // it, and a memfd takes the policy into the file itself. Copies made on
+  // write go where the writing thread runs, usually on the image's node.
+  h->CowFrom = c->From; h->CowTo = c->To;
+}
+
+void DmmWmaCowFini(DmmWmaCow *c) {
+  if (c->Fd >= 0)
+    close(c->Fd);
+  c->Fd = -1;
+}
+
+bool DmmWmaSpillInit(const char *dir, size_t rssCapMb) {
+  int fd = open(dir, O_TMPFILE | O_RDWR | O_CLOEXEC, 0600);
+  if (fd < 0) {
+    // No O_TMPFILE there: make one and unlink it right away
+    char path[strlen(dir) + 16];
+    sprintf(path, "%s/dmm-XXXXXX", dir);
+    fd = mkstemp(path);
+    if (fd >= 0)
+      unlink(path);
+  }
+  if (fd < 0) {
+    perror("spill file");
+    return false;
+  }
+  wmaPool.SpillFd = fd;
+  wmaPool.CapNrPage = rssCapMb * 256;
+  if (rssCapMb != 0)
+    wmaPool.StatmFd = open("/proc/self/statm", O_RDONLY | O_CLOEXEC);
+  return true;
+}
+
+// Resident pages of the whole process
+static size_t _wmaNrResident(void) {
+  char buf[64];
+  ssize_t n = pread(wmaPool.StatmFd, buf, sizeof(buf) - 1, 0);
+  if (n <= 0)
+    return 0;
+  buf[n] = '\0';
+  char *at = strchr(buf, ' ');
+  return at == NULL ? 0 : strtoull(at + 1, NULL, 10);
+}
+
+void DmmWmaTouch(uint8_t *wma, size_t nrByte) {
+  if (wmaPool.SpillFd < 0)
+    return;
+  _wmaHdr *h = (_wmaHdr*)(wma + nrByte);
+  if (h->SpillAt < 0)
+    return;
+  pthread_mutex_lock(&wmaPool.Mu);
+  _wmaUnlink(h);
+  _wmaAppend(h);
+  pthread_mutex_unlock(&wmaPool.Mu);
+  if (wmaPool.StatmFd < 0 || _wmaNrResident() <= wmaPool.CapNrPage)
+    return;
+  // One thread trims at a time; the others carry on
+  if (pthread_mutex_trylock(&wmaPool.TrimMu) != 0)
+    return;
+  pthread_mutex_lock(&wmaPool.Mu);
+  for (_wmaHdr *o = wmaPool.Lru.LruNext; o != h && o != &wmaPool.Lru &&
+       _wmaNrResident() > wmaPool.CapNrPage; o = o->LruNext) {
+    if (o->Out)
+      continue;
+    // Written back to the file and reclaimed; dropping the mapping instead
+    // still takes it off this process's RSS
+#ifdef MADV_PAGEOUT
+    if (madvise(_wmaOf(o), o->NrByte, MADV_PAGEOUT) != 0)
+#endif
+      madvise(_wmaOf(o), o->NrByte, MADV_DONTNEED);
+    o->Out = true;
+  }
+  pthread_mutex_unlock(&wmaPool.Mu);
+  pthread_mutex_unlock(&wmaPool.TrimMu);
+}
+
+size_t DmmWmaHighWater(const uint8_t *wma, size_t nrByte,
+                       size_t from, size_t to) {
+  const _wmaHdr *h = (const _wmaHdr*)(wma + nrByte);
+  size_t top = from;
+  // Paged out pages are only in the spill file, as its data extents
+  if (h->SpillAt >= 0) {
+    off_t end = h->SpillAt + to;
+    for (off_t at = h->SpillAt + from; at < end;) {
+      off_t data = lseek(wmaPool.SpillFd, at, SEEK_DATA);
+      if (data < 0 || data >= end)
+        break;
+      off_t hole = lseek(wmaPool.SpillFd, data, SEEK_HOLE);
+      at = hole < 0 || hole > end ? end : hole;
+      top = at - h->SpillAt;
+    }
+  }
+  // Resident or swapped out pages, from the top down
+  pthread_once(&wmaPool.Once, _wmaOpen);
+  if (wmaPool.PagemapFd < 0)
+    return to - from;
+  uint64_t pm[_wmaNrEntry];
+  for (size_t end = to / 4096; end * 4096 > top;) {
+    size_t nr = end - top / 4096 < _wmaNrEntry ? end - top / 4096 : _wmaNrEntry;
+    off_t off = (uintptr_t)(wma + (end - nr) * 4096) / 4096 * sizeof(uint64_t);
+    if (pread(wmaPool.PagemapFd, pm, nr * sizeof(uint64_t), off) !=
+        (ssize_t)(nr * sizeof(uint64_t)))
+      return to - from;
+    for (size_t i = nr; i-- > 0;)
+      if (pm[i] >> _pmPresent & 1 || pm[i] >> _pmSwapped & 1)
+        return (end - nr + i + 1) * 4096 - from;
+    end -= nr;
+  }
+  return top - from;
+}